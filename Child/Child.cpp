@@ -1,85 +1,1492 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <psapi.h>
 #include <shellapi.h>
 
+#include <algorithm>
+#include <deque>
 #include <string>
+#include <vector>
 
 #include <SDL.h>
 #include <SDL_syswm.h>
 #include <SDL_opengl.h>
 
-static bool running = true;
+#include <Protocol.h>
+
+#include "CommandBuffer.h"
+#include "Document.h"
+#include "FrameScheduler.h"
+#include "GlState.h"
+#include "ProgramCache.h"
+#include "QuadBatch.h"
+#include "Raster.h"
+#include "TextRenderer.h"
+#include "TextureManager.h"
+#include "TileRenderer.h"
+
+// scene simulation
+#define CHILD_TICK_RATE             120     // fixed simulation ticks per second
+#define CHILD_FADE_SECONDS          0.25    // color transition time after pressing space
+#define CHILD_LATENCY_REPORT_MS     5000    // event handling latency logging interval
+
+// headless mode defaults
+#define CHILD_HEADLESS_FRAMES       600
+#define CHILD_HEADLESS_WIDTH        1280
+#define CHILD_HEADLESS_HEIGHT       720
+
+// framebuffer reallocation during live resize
+#define CHILD_STORAGE_GRANULARITY   256     // grow renderbuffer storage in steps of this many pixels
+#define CHILD_RESIZE_SETTLE_MS      250     // trim storage to the exact size once resizing stopped this long
+
+// damage tracking
+#define CHILD_DAMAGE_HISTORY        8       // frames of damage kept to bring older slots up to date
+#define CHILD_MARKER_SIZE           48      // pointer highlight, the part of the scene that moves
+
+// document loading
+#define CHILD_PROGRESS_HEIGHT       4       // load progress bar along the bottom of the view
+
+struct Scene
+{
+    GLfloat color[4];
+};
+
+// What the render thread may draw of the document
+struct DocumentView
+{
+    uint32_t generation;    // changes whenever the document is replaced or closed
+    uint32_t blocks;        // indexed so far
+    uint32_t progress;      // per mille of the file indexed, 1000 once loaded
+};
+
+// Immutable state handed from the update thread to the render thread
+struct Snapshot
+{
+    Scene previous;
+    Scene current;
+    Uint64 tickCounter;     // performance counter at which current was due
+    ChildSize size;         // framebuffer size requested by Parent
+    bool animating;         // keep rendering after the last tick; previous and current differ
+    ChildPoint pointer;     // client coordinates, negative without a pointer
+    uint32_t exposures;     // window exposures so far; each one needs a full redraw
+    DocumentView document;
+};
+
+// Everything a rendered frame depends on; damage is the difference between two of them
+struct FrameState
+{
+    Scene scene;
+    RasterRect marker;      // pointer highlight in bottom-up framebuffer coordinates, empty without a pointer
+    ChildSize size;
+    uint32_t exposures;
+    DocumentView document;
+};
+
+static std::atomic<bool> running(true);
 static SDL_Window* window = nullptr;
 static SDL_GLContext context;
 static SDL_SysWMinfo sysinfo;
 
-std::string LastErrorMessage()
+static ChildChannel* channel = nullptr;
+static Ring commands;   // consumed by Child
+static Ring replies;    // produced by Child
+static HANDLE replyEvent = NULL;
+static HANDLE commandEvent = NULL;
+static bool repliesPending = false;
+static bool repliesBlocked = false;     // a command waits for room in the reply ring
+static bool parked = true;
+
+// render on demand mode
+static bool onDemand = false;
+static bool dirty = true;
+static Uint32 cpuReportTime = 0;
+static unsigned long long cpuReportTicks = 0;
+
+// simulated in fixed ticks on the update thread
+static Scene previousScene = { { 0.2f, 0.4f, 0.1f, 1.0f } };
+static Scene currentScene = previousScene;
+static Scene targetScene = previousScene;
+static ChildSize viewSize = { 0, 0 };
+static ChildPoint pointer = { -1, -1 };
+static uint32_t exposures = 0;
+static const GLfloat markerColor[4] = { 0.9f, 0.9f, 0.9f, 1.0f };
+
+// render thread, fed with snapshots through a triple buffer
+static Snapshot snapshots[3];
+static std::atomic<uint32_t> snapshotMiddle;
+static TripleBufferWriter snapshotWriter;
+static HANDLE renderEvent = NULL;   // wakes the render thread in on-demand mode
+static uint32_t frameRate = 0;
+static uint32_t renderCost = 0;
+static Uint32 parkedTicks = 0;
+static Uint64 adoptCounter = 0;
+
+// event handling latency on the update thread
+struct InputStamp
+{
+    Uint32 ticks;           // SDL timestamp of the event, to pair the stamp with it
+    Uint64 counter;         // performance counter when SDL queued it
+};
+
+static std::vector<float> eventLatencies;
+static std::deque<InputStamp> inputStamps;  // queued input events in queue order
+static Uint32 latencyReportTime = 0;
+
+// shared framebuffer mode
+static FramebufferHeader* framebuffer = nullptr;
+static TripleBufferWriter backBuffer;
+static ChildSize requestedSize = { 0, 0 };   // last size asked for by Parent
+static ChildSize framebufferSize = { 0, 0 };  // rendered and published size
+static ChildSize storageSize = { 0, 0 };      // allocated renderbuffer size, at least framebufferSize
+static size_t framebufferCommitted = 0;       // bytes at the start of every slot backed by memory
+static Uint32 resizeTime = 0;
+static uint32_t reallocations = 0;
+static uint32_t frameSequence = 0;
+static GLuint fbo = 0;
+static GLuint colorbuffer = 0;
+
+// damage tracking on the render thread
+static FrameState lastFrame;
+static bool lastFrameValid = false;
+static RasterRect damageHistory[CHILD_DAMAGE_HISTORY];   // by frame sequence
+static uint32_t publishedSlot = 0;
+static unsigned long long renderedPixels = 0;
+static unsigned long long transferredPixels = 0;
+static bool software = false;   // render with the CPU rasterizer straight into the shared slots
+static TileRenderer* tileRenderer = nullptr;
+
+// A recorded part of the scene, recorded again only when what it was recorded from changes
+struct SceneLayer
+{
+    CommandBuffer commands;
+    uint64_t source;    // hash of the inputs it was recorded from
+    bool recorded;
+};
+
+static SceneLayer backgroundLayer = {};
+static SceneLayer markerLayer = {};
+static SceneLayer documentLayer = {};
+static CommandBuffer replayCommands;    // loaded with -replay and drawn instead of the scene
+static bool replaying = false;
+static uint32_t layersRecorded = 0;
+static uint32_t layersReplayed = 0;
+
+static GlState glState;     // used by whichever thread has the context current
+static QuadBatch quadBatch;  // everything but clears in GL mode
+static ProgramCache programCache;
+static Document document;   // opened with CHILD_COMMAND_OPEN
+static DocumentLoader documentLoader;
+static std::wstring documentPath;           // of the last CHILD_COMMAND_OPEN, loaded again by CHILD_COMMAND_RELOAD
+static Document reloadedDocument;           // loading while the previous version stays on screen, swapped in once done
+static bool documentReloading = false;
+static SDL_mutex* documentLock = nullptr;   // held by the render thread while it reads the document, by the update thread while it replaces it
+static uint32_t documentGeneration = 0;     // guarded by documentLock
+static Uint64 documentStart = 0;
+static ChildDocument documentReply;           // last CHILD_REPLY_DOCUMENT, pushed again while the reply ring is full
+static bool documentReplyPending = false;
+static std::vector<DocumentItem> documentItems;     // render thread scratch
+static PFNGLGENFRAMEBUFFERSPROC glGenFramebuffers = nullptr;
+static PFNGLDELETEFRAMEBUFFERSPROC glDeleteFramebuffers = nullptr;
+static PFNGLFRAMEBUFFERRENDERBUFFERPROC glFramebufferRenderbuffer = nullptr;
+static PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus = nullptr;
+static PFNGLGENRENDERBUFFERSPROC glGenRenderbuffers = nullptr;
+static PFNGLDELETERENDERBUFFERSPROC glDeleteRenderbuffers = nullptr;
+static PFNGLRENDERBUFFERSTORAGEPROC glRenderbufferStorage = nullptr;
+
+std::string LastErrorMessage()
+{
+    DWORD id = GetLastError();
+    if (id == 0) return std::string();
+
+    LPSTR buffer = nullptr;
+    size_t size = FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, 
+                                 nullptr, id, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPSTR)&buffer, 0, nullptr);
+
+    std::string message(buffer, size);
+    LocalFree(buffer);
+    return message;
+}
+
+bool CreateFramebuffer()
+{
+    glGenFramebuffers = (PFNGLGENFRAMEBUFFERSPROC)SDL_GL_GetProcAddress("glGenFramebuffers");
+    glDeleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSPROC)SDL_GL_GetProcAddress("glDeleteFramebuffers");
+    glFramebufferRenderbuffer = (PFNGLFRAMEBUFFERRENDERBUFFERPROC)SDL_GL_GetProcAddress("glFramebufferRenderbuffer");
+    glCheckFramebufferStatus = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)SDL_GL_GetProcAddress("glCheckFramebufferStatus");
+    glGenRenderbuffers = (PFNGLGENRENDERBUFFERSPROC)SDL_GL_GetProcAddress("glGenRenderbuffers");
+    glDeleteRenderbuffers = (PFNGLDELETERENDERBUFFERSPROC)SDL_GL_GetProcAddress("glDeleteRenderbuffers");
+    glRenderbufferStorage = (PFNGLRENDERBUFFERSTORAGEPROC)SDL_GL_GetProcAddress("glRenderbufferStorage");
+
+    if (!glGenFramebuffers || !glDeleteFramebuffers || !glFramebufferRenderbuffer || !glCheckFramebufferStatus ||
+        !glGenRenderbuffers || !glDeleteRenderbuffers || !glRenderbufferStorage)
+    {
+        SDL_Log("Framebuffer objects are not supported");
+        return false;
+    }
+
+    // The window stays hidden, so render into an offscreen framebuffer object
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &colorbuffer);
+    glState.BindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glState.BindRenderbuffer(GL_RENDERBUFFER, colorbuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorbuffer);
+    return true;
+}
+
+void AllocateStorage(ChildSize size)
+{
+    storageSize = size;
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, storageSize.width, storageSize.height);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        SDL_Log("Incomplete framebuffer at %dx%d", storageSize.width, storageSize.height);
+    }
+
+    // New storage holds no defined pixels
+    lastFrameValid = false;
+
+    reallocations++;
+    SDL_Log("Allocated %dx%d framebuffer for %dx%d (%u allocations)",
+            storageSize.width, storageSize.height, framebufferSize.width, framebufferSize.height, reallocations);
+}
+
+// Parent only reserves the slots; commits them as frames grow, with the same headroom as GL storage
+bool CommitFramebuffer(ChildSize size)
+{
+    size_t needed = FramebufferSlotSize(size.width, size.height);
+    if (needed <= framebufferCommitted) return true;
+
+    size_t bytes = FramebufferSlotSize(SDL_min(size.width + CHILD_STORAGE_GRANULARITY, framebuffer->maxWidth),
+                                       SDL_min(size.height + CHILD_STORAGE_GRANULARITY, framebuffer->maxHeight));
+
+    for (uint32_t slot = 0; slot < FRAMEBUFFER_SLOTS; ++slot)
+    {
+        if (!VirtualAlloc(FramebufferPixels(framebuffer, slot), bytes, MEM_COMMIT, PAGE_READWRITE))
+        {
+            SDL_Log("Unable to commit %.1f MB of framebuffer: %s", bytes / 1048576.0, LastErrorMessage().c_str());
+            return false;
+        }
+    }
+
+    framebufferCommitted = bytes;
+    return true;
+}
+
+void ResizeFramebuffer(ChildSize size)
+{
+    // Clamp to the slot size Parent allocated; without memory for the new size the frame keeps the old one
+    requestedSize = size;
+    ChildSize clamped = { SDL_max(1, SDL_min(size.width, framebuffer->maxWidth)), SDL_max(1, SDL_min(size.height, framebuffer->maxHeight)) };
+    if (!CommitFramebuffer(clamped)) return;
+
+    framebufferSize = clamped;
+    resizeTime = SDL_GetTicks();
+
+    if (software) return;
+
+    // Shrinking only moves the viewport; growing rounds up so a drag does not reallocate on every step
+    if (framebufferSize.width > storageSize.width || framebufferSize.height > storageSize.height)
+    {
+        ChildSize storage;
+        storage.width = SDL_min(SDL_max(framebufferSize.width, storageSize.width + CHILD_STORAGE_GRANULARITY), framebuffer->maxWidth);
+        storage.height = SDL_min(SDL_max(framebufferSize.height, storageSize.height + CHILD_STORAGE_GRANULARITY), framebuffer->maxHeight);
+        AllocateStorage(storage);
+    }
+}
+
+// Returns true while the storage is larger than needed and waits for the size to settle
+bool TrimFramebuffer()
+{
+    if (software) return false;
+    if (storageSize.width == framebufferSize.width && storageSize.height == framebufferSize.height) return false;
+    if (SDL_GetTicks() - resizeTime < CHILD_RESIZE_SETTLE_MS) return true;
+
+    AllocateStorage(framebufferSize);
+    return false;
+}
+
+void SignalParent()
+{
+    if (channel == nullptr) return;
+
+    // Pairs with Parent setting parentWaiting before its final poll; only wake it when it actually sleeps
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (channel->parentWaiting.load(std::memory_order_relaxed))
+    {
+        SetEvent(replyEvent);
+    }
+}
+
+RasterImage BackImage()
+{
+    // Row 0 is the bottom row of the frame
+    uint32_t* pixels = (uint32_t*)FramebufferPixels(framebuffer, backBuffer.Back());
+    return { pixels, framebufferSize.width, framebufferSize.height, framebufferSize.width };
+}
+
+RasterRect FrameDamage(const FrameState& next)
+{
+    if (!lastFrameValid || next.size.width != lastFrame.size.width || next.size.height != lastFrame.size.height ||
+        next.exposures != lastFrame.exposures || memcmp(&next.scene, &lastFrame.scene, sizeof(Scene)) != 0 ||
+        memcmp(&next.document, &lastFrame.document, sizeof(DocumentView)) != 0)
+    {
+        return { 0, 0, next.size.width, next.size.height };
+    }
+
+    // Only the pointer highlight moved
+    if (memcmp(&next.marker, &lastFrame.marker, sizeof(RasterRect)) != 0)
+    {
+        return RasterUnion(lastFrame.marker, next.marker);
+    }
+
+    return { 0, 0, 0, 0 };
+}
+
+RasterRect SlotDamage(uint32_t slot)
+{
+    // Everything published since this slot was last written; with three slots that is at least one other frame
+    const FramebufferSlot& frame = framebuffer->slots[slot];
+
+    if (frame.sequence == 0 || frame.width != framebufferSize.width || frame.height != framebufferSize.height ||
+        frameSequence - frame.sequence >= CHILD_DAMAGE_HISTORY)
+    {
+        return { 0, 0, framebufferSize.width, framebufferSize.height };
+    }
+
+    RasterRect damage = { 0, 0, 0, 0 };
+    for (uint32_t sequence = frame.sequence + 1; sequence <= frameSequence; ++sequence)
+    {
+        damage = RasterUnion(damage, damageHistory[sequence % CHILD_DAMAGE_HISTORY]);
+    }
+    return damage;
+}
+
+RasterRect MarkerRect(ChildPoint point, ChildSize size)
+{
+    if (point.x < 0 || point.y < 0) return { 0, 0, 0, 0 };
+
+    // Client coordinates are top-down, frames bottom-up
+    RasterRect marker = { point.x - CHILD_MARKER_SIZE / 2, size.height - point.y - CHILD_MARKER_SIZE / 2, CHILD_MARKER_SIZE, CHILD_MARKER_SIZE };
+    return RasterIntersect(marker, { 0, 0, size.width, size.height });
+}
+
+void PublishFrame(const RasterRect& damage, const RasterRect& transfer)
+{
+    // Read back straight into the shared slot, only the part that is out of date; Parent presents it from there
+    uint32_t slot = backBuffer.Back();
+    if (!software)
+    {
+        uint8_t* pixels = FramebufferPixels(framebuffer, slot) + ((size_t)transfer.y * framebufferSize.width + transfer.x) * 4;
+        glPixelStorei(GL_PACK_ROW_LENGTH, framebufferSize.width);
+        glReadPixels(transfer.x, transfer.y, transfer.width, transfer.height, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    transferredPixels += (unsigned long long)transfer.width * transfer.height;
+
+    FramebufferSlot& frame = framebuffer->slots[slot];
+    frame.width = framebufferSize.width;
+    frame.height = framebufferSize.height;
+    frame.damageX = damage.x;
+    frame.damageY = damage.y;
+    frame.damageWidth = damage.width;
+    frame.damageHeight = damage.height;
+    frame.sequence = ++frameSequence;
+    damageHistory[frameSequence % CHILD_DAMAGE_HISTORY] = damage;
+
+    publishedSlot = slot;
+    backBuffer.Publish();
+    SignalParent();
+}
+
+// Returns false when the reply ring is full; the caller decides whether to retry or drop the reply
+bool PushReply(uint32_t type, const void* payload, uint32_t size)
+{
+    if (!replies.Push(type, payload, size)) return false;
+
+    repliesPending = true;
+    return true;
+}
+
+void NotifyParent()
+{
+    if (!repliesPending) return;
+    repliesPending = false;
+    SignalParent();
+}
+
+void WaitForWork(DWORD timeout)
+{
+    // Announce the wait before the final check so a command pushed in between still signals commandEvent
+    channel->childWaiting.store(1, std::memory_order_seq_cst);
+
+    // Parent drains replies without signalling, so a command held back for room is retried shortly
+    if (repliesBlocked)
+    {
+        MsgWaitForMultipleObjectsEx(0, nullptr, SDL_min(timeout, (DWORD)1), QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+    }
+    else if (commands.Empty())
+    {
+        MsgWaitForMultipleObjectsEx(1, &commandEvent, timeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+    }
+
+    channel->childWaiting.store(0, std::memory_order_relaxed);
+}
+
+Uint32 ReportCpuUsage()
+{
+    const Uint32 interval = 60000;
+
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    Uint32 now = SDL_GetTicks();
+    Uint32 elapsed = now - cpuReportTime;
+
+    if (cpuReportTime != 0 && elapsed < interval) return interval - elapsed;
+
+    GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime);
+    unsigned long long ticks = ((unsigned long long)kernelTime.dwHighDateTime << 32 | kernelTime.dwLowDateTime) +
+                               ((unsigned long long)userTime.dwHighDateTime << 32 | userTime.dwLowDateTime);
+
+    if (cpuReportTime != 0)
+    {
+        SDL_Log("Used %.1f ms CPU in the last %.1f s (%s)", (ticks - cpuReportTicks) / 10000.0, elapsed / 1000.0,
+                onDemand ? "render on demand" : "continuous rendering");
+    }
+
+    cpuReportTime = now;
+    cpuReportTicks = ticks;
+    return interval;
+}
+
+void UpdateScene(double seconds)
+{
+    previousScene = currentScene;
+
+    GLfloat step = (GLfloat)(seconds / CHILD_FADE_SECONDS);
+    for (int i = 0; i < 4; ++i)
+    {
+        GLfloat delta = targetScene.color[i] - currentScene.color[i];
+        currentScene.color[i] += SDL_max(-step, SDL_min(delta, step));
+    }
+}
+
+bool SceneAnimating()
+{
+    return memcmp(&previousScene, &currentScene, sizeof(Scene)) != 0 || memcmp(&currentScene, &targetScene, sizeof(Scene)) != 0;
+}
+
+Scene InterpolateScene(const Snapshot& snapshot)
+{
+    // Render between the last two ticks, one tick behind the simulation
+    double elapsed = (double)(SDL_GetPerformanceCounter() - snapshot.tickCounter) / (double)SDL_GetPerformanceFrequency();
+    GLfloat alpha = (GLfloat)SDL_min(elapsed * CHILD_TICK_RATE, 1.0);
+
+    Scene scene;
+    for (int i = 0; i < 4; ++i)
+    {
+        scene.color[i] = snapshot.previous.color[i] + (snapshot.current.color[i] - snapshot.previous.color[i]) * alpha;
+    }
+    return scene;
+}
+
+void PublishSnapshot(Uint64 tickCounter)
+{
+    Snapshot& snapshot = snapshots[snapshotWriter.Back()];
+    snapshot.previous = previousScene;
+    snapshot.current = currentScene;
+    snapshot.tickCounter = tickCounter;
+    snapshot.size = viewSize;
+    snapshot.animating = SceneAnimating();
+    snapshot.pointer = pointer;
+    snapshot.exposures = exposures;
+    snapshot.document.generation = documentGeneration;
+    snapshot.document.blocks = (uint32_t)document.Blocks().size();
+    const Document& loading = documentReloading ? reloadedDocument : document;
+    snapshot.document.progress = documentLoader.Loading() ? (uint32_t)(loading.Indexed() * 1000 / SDL_max(1ull, loading.Size())) : 1000;
+
+    snapshotWriter.Publish();
+    if (onDemand) SetEvent(renderEvent);
+}
+
+void RecordLatency(double microseconds)
+{
+    eventLatencies.push_back((float)microseconds);
+}
+
+bool IsInputEvent(const SDL_Event& event)
+{
+    return event.type == SDL_KEYDOWN || event.type == SDL_KEYUP || event.type == SDL_MOUSEBUTTONDOWN ||
+           event.type == SDL_MOUSEBUTTONUP || event.type == SDL_MOUSEMOTION;
+}
+
+// SDL timestamps are whole milliseconds, so input is stamped again with the performance counter as SDL queues it
+int SDLCALL StampInput(void* userdata, SDL_Event* event)
+{
+    if (IsInputEvent(*event)) inputStamps.push_back({ event->common.timestamp, SDL_GetPerformanceCounter() });
+    return 1;
+}
+
+void RecordInputLatency(const SDL_Event& event)
+{
+    // Stamps of events SDL failed to queue are skipped; events queued before the watch fall back to milliseconds
+    while (!inputStamps.empty() && SDL_TICKS_PASSED(event.common.timestamp, inputStamps.front().ticks) &&
+           inputStamps.front().ticks != event.common.timestamp)
+    {
+        inputStamps.pop_front();
+    }
+
+    if (!inputStamps.empty() && inputStamps.front().ticks == event.common.timestamp)
+    {
+        RecordLatency((double)(SDL_GetPerformanceCounter() - inputStamps.front().counter) * 1000000.0 / (double)SDL_GetPerformanceFrequency());
+        inputStamps.pop_front();
+    }
+    else
+    {
+        RecordLatency((SDL_GetTicks() - event.common.timestamp) * 1000.0);
+    }
+}
+
+void ReportLatency()
+{
+    Uint32 elapsed = SDL_GetTicks() - latencyReportTime;
+    if (elapsed < CHILD_LATENCY_REPORT_MS) return;
+    latencyReportTime = SDL_GetTicks();
+
+    if (eventLatencies.empty()) return;
+
+    std::sort(eventLatencies.begin(), eventLatencies.end());
+    size_t count = eventLatencies.size();
+
+    SDL_Log("Handled %u events and commands, latency p50 %.0f us, p99 %.0f us, max %.0f us",
+            (unsigned)count, eventLatencies[count / 2], eventLatencies[count * 99 / 100], eventLatencies[count - 1]);
+
+    eventLatencies.clear();
+}
+
+void FinishDocument(bool opened)
+{
+    if (documentReloading)
+    {
+        // A reload that fails leaves the previous version open
+        if (opened)
+        {
+            SDL_LockMutex(documentLock);
+            document.Swap(reloadedDocument);
+            documentGeneration++;
+            SDL_UnlockMutex(documentLock);
+        }
+        reloadedDocument.Close();
+    }
+    else if (!opened)
+    {
+        SDL_LockMutex(documentLock);
+        document.Close();
+        documentGeneration++;
+        SDL_UnlockMutex(documentLock);
+    }
+
+    ChildDocument reply = {};
+    reply.opened = opened ? 1 : 0;
+    reply.reloaded = documentReloading ? 1 : 0;
+    reply.packed = opened && document.Packed() ? 1 : 0;
+    reply.loadMilliseconds = (uint32_t)((SDL_GetPerformanceCounter() - documentStart) * 1000 / SDL_GetPerformanceFrequency());
+    reply.bytes = document.Size();
+    reply.items = document.Items();
+    reply.reused = opened ? document.Reused() : 0;
+
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) reply.peakWorkingSet = counters.PeakWorkingSetSize;
+
+    if (opened)
+    {
+        SDL_Log("%s a %.1f MB %s with %llu items in %u ms, %.1f MB reused, peak working set %.1f MB", documentReloading ? "Reloaded" : "Opened",
+                reply.bytes / 1048576.0, reply.packed ? "pack" : "document", (unsigned long long)reply.items, reply.loadMilliseconds,
+                reply.reused / 1048576.0, reply.peakWorkingSet / 1048576.0);
+    }
+
+    documentReloading = false;
+    documentReply = reply;
+    documentReplyPending = !PushReply(CHILD_REPLY_DOCUMENT, &reply, sizeof(ChildDocument));
+    dirty = true;
+}
+
+// Loads documentPath in place of the document from the start
+void LoadDocument()
+{
+    documentReloading = false;
+    reloadedDocument.Close();
+
+    // Joining the loader threads, mapping and unmapping all happen outside the lock; the render thread may be
+    // reading the document this one replaces, so it only waits for the swap. An up to date pack needs no loading.
+    documentLoader.Cancel();
+    Document opened;
+    bool packed = opened.OpenPack(documentPath.c_str());
+    bool mapped = packed || opened.Map(documentPath.c_str());
+
+    SDL_LockMutex(documentLock);
+    document.Swap(opened);
+    documentGeneration++;
+    SDL_UnlockMutex(documentLock);
+
+    opened.Close();
+    bool started = packed || (mapped && documentLoader.Start(&document, 0, commandEvent));
+
+    dirty = true;
+    if (packed || !started) FinishDocument(packed);
+}
+
+void OpenDocument(const RingRecord* record)
+{
+    documentPath.assign((const wchar_t*)(record + 1), record->size / sizeof(wchar_t));
+    documentStart = SDL_GetPerformanceCounter();
+    LoadDocument();
+}
+
+// Loads the file again beside the document, parsing only the chunks it does not already hold
+void ReloadDocument()
+{
+    if (documentPath.empty())
+    {
+        SDL_Log("No document to reload");
+        return;
+    }
+
+    // Parent still waits for the open to be answered; loading the new version from the start answers it
+    if (documentLoader.Loading() && !documentReloading)
+    {
+        SDL_Log("The document changed while opening, loading it again");
+        LoadDocument();
+        return;
+    }
+
+    // Cancels a reload in progress and starts over against the document on screen
+    documentReloading = true;
+    documentStart = SDL_GetPerformanceCounter();
+    documentLoader.Cancel();
+
+    bool packed = reloadedDocument.OpenPack(documentPath.c_str());
+    bool started = packed || documentLoader.Start(&reloadedDocument, documentPath.c_str(), 0, commandEvent, &document);
+
+    dirty = true;
+    if (packed || !started) FinishDocument(packed);
+}
+
+// Adds the windows indexed in the background since the last call and reports progress to Parent
+void UpdateDocument()
+{
+    // Parent waits on this reply to retitle and reload, so it is kept until the reply ring has room
+    if (documentReplyPending) documentReplyPending = !PushReply(CHILD_REPLY_DOCUMENT, &documentReply, sizeof(ChildDocument));
+
+    if (!documentLoader.Loading()) return;
+
+    Document& loading = documentReloading ? reloadedDocument : document;
+    uint64_t indexed = loading.Indexed();
+    DocumentLoad load = documentLoader.Commit();
+
+    if (loading.Indexed() != indexed)
+    {
+        // Progress is dropped when the reply ring is full; the next update supersedes it
+        ChildProgress progress = { loading.Indexed(), loading.Size(), loading.Items() };
+        PushReply(CHILD_REPLY_PROGRESS, &progress, sizeof(ChildProgress));
+        dirty = true;
+    }
+
+    if (load == DocumentLoad::Done) FinishDocument(true);
+    else if (load == DocumentLoad::Failed) FinishDocument(false);
+}
+
+void HandleCommands()
+{
+    repliesBlocked = false;
+
+    while (const RingRecord* record = commands.Peek())
+    {
+        switch (record->type)
+        {
+            case CHILD_COMMAND_PING:
+            {
+                // Leave the ping in the ring until its pong fits, so none is lost
+                if (!PushReply(CHILD_REPLY_PONG, record + 1, record->size))
+                {
+                    repliesBlocked = true;
+                    return;
+                }
+
+                // Parent stamps pings with its performance counter, which is the same clock in every process
+                int64_t timestamp;
+                memcpy(&timestamp, record + 1, sizeof(int64_t));
+                RecordLatency((double)(SDL_GetPerformanceCounter() - timestamp) * 1000000.0 / (double)SDL_GetPerformanceFrequency());
+                break;
+            }
+
+            case CHILD_COMMAND_OPEN:
+            {
+                OpenDocument(record);
+                break;
+            }
+
+            case CHILD_COMMAND_RELOAD:
+            {
+                ReloadDocument();
+                break;
+            }
+
+            case CHILD_COMMAND_ADOPT:
+            {
+                memcpy(&viewSize, record + 1, sizeof(ChildSize));
+                parked = false;
+                dirty = true;
+                break;
+            }
+
+            case CHILD_COMMAND_RESIZE:
+            {
+                memcpy(&viewSize, record + 1, sizeof(ChildSize));
+                dirty = true;
+                break;
+            }
+
+            case CHILD_COMMAND_POINTER:
+            {
+                memcpy(&pointer, record + 1, sizeof(ChildPoint));
+                dirty = true;
+                break;
+            }
+
+            default:
+            {
+                if (!PushReply(CHILD_REPLY_ACK, &record->type, sizeof(uint32_t)))
+                {
+                    repliesBlocked = true;
+                    return;
+                }
+
+                SDL_Log("Received command %u", record->type);
+                break;
+            }
+        }
+
+        commands.Consume();
+    }
+}
+
+// Replays recorded commands with OpenGL, touching only pixels inside clip. Quads are batched and
+// drawn at the next clear or once replay ends; every command is a layer of its own to keep their order.
+struct GlCommandBackend
+{
+    RasterRect clip;
+    ChildSize size;
+    uint32_t layer;
+
+    void Fill(RasterRect rect, uint32_t color)
+    {
+        RasterRect area = RasterIntersect(rect, clip);
+        if (RasterEmpty(area)) return;
+        Flush();
+
+        // Colors are premultiplied already; a clear stores them as is, like the CPU fill
+        glState.Scissor(area.x, area.y, area.width, area.height);
+        glState.ClearColor((color >> 16 & 0xFF) / 255.0f, (color >> 8 & 0xFF) / 255.0f, (color & 0xFF) / 255.0f, (color >> 24) / 255.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+    void FillGradient(RasterRect rect, uint32_t left, uint32_t right)
+    {
+        Quad quad = { (float)rect.x, (float)rect.y, (float)rect.width, (float)rect.height, 0.0f, 0.0f, 1.0f, 1.0f, left, right };
+        quadBatch.Add(quad, 0, layer++);
+    }
+
+    void Blend(RasterRect rect, uint32_t color)
+    {
+        quadBatch.Add(rect, color, layer++);
+    }
+
+    void DrawImage(RasterRect, uint32_t)
+    {
+        // Command buffers carry no texture table for GL yet
+    }
+
+    void Flush()
+    {
+        glState.Scissor(clip.x, clip.y, clip.width, clip.height);
+        quadBatch.Flush(size.width, size.height);
+        layer = 0;
+    }
+};
+
+// Starts recording a layer again unless its inputs hash the same as last time; returns true when it did
+bool LayerStale(SceneLayer& layer, const void* source, size_t size)
+{
+    uint64_t hash = CommandHash(source, size);
+    if (layer.recorded && layer.source == hash) return false;
+
+    layer.commands.Clear();
+    layer.source = hash;
+    layer.recorded = true;
+    layersRecorded++;
+    return true;
+}
+
+void RecordDocument(const FrameState& state)
+{
+    RasterRect view = { 0, 0, state.size.width, state.size.height };
+
+    // A snapshot from before the document was replaced refers to blocks that are gone; a newer one follows
+    SDL_LockMutex(documentLock);
+    if (state.document.generation == documentGeneration)
+    {
+        RecordDocumentPreview(document, state.document.blocks, view, documentLayer.commands, documentItems);
+    }
+    SDL_UnlockMutex(documentLock);
+
+    if (state.document.progress < 1000)
+    {
+        documentLayer.commands.Fill({ 0, 0, view.width, CHILD_PROGRESS_HEIGHT }, 0xFF202020);
+        documentLayer.commands.Fill({ 0, 0, (int32_t)(view.width * (int64_t)state.document.progress / 1000), CHILD_PROGRESS_HEIGHT }, 0xFFE0E0E0);
+    }
+}
+
+void RecordScene(const FrameState& state)
+{
+    // The background does not depend on the pointer, so moving it replays the background as recorded
+    struct { Scene scene; ChildSize size; } background = { state.scene, state.size };
+    if (LayerStale(backgroundLayer, &background, sizeof(background)))
+    {
+        const GLfloat* color = state.scene.color;
+        backgroundLayer.commands.Fill({ 0, 0, state.size.width, state.size.height }, RasterColor(color[0], color[1], color[2], color[3]));
+    }
+
+    // Items indexed so far, redrawn as loading adds blocks
+    struct { DocumentView document; ChildSize size; } documentSource = { state.document, state.size };
+    if (LayerStale(documentLayer, &documentSource, sizeof(documentSource)))
+    {
+        RecordDocument(state);
+    }
+
+    if (LayerStale(markerLayer, &state.marker, sizeof(RasterRect)) && !RasterEmpty(state.marker))
+    {
+        markerLayer.commands.Fill(state.marker, RasterColor(markerColor[0], markerColor[1], markerColor[2], markerColor[3]));
+    }
+}
+
+void RenderScene(const FrameState& state, const RasterRect& clip)
+{
+    renderedPixels += (unsigned long long)clip.width * clip.height;
+
+    const CommandBuffer* layers[] = { &backgroundLayer.commands, &documentLayer.commands, &markerLayer.commands };
+    uint32_t layerCount = 3;
+
+    if (replaying)
+    {
+        layers[0] = &replayCommands;
+        layerCount = 1;
+    }
+    else
+    {
+        RecordScene(state);
+    }
+
+    layersReplayed += layerCount;
+
+    if (software)
+    {
+        for (uint32_t i = 0; i < layerCount; ++i)
+        {
+            layers[i]->Replay(*tileRenderer, nullptr, 0);
+        }
+
+        tileRenderer->Render(BackImage(), clip);
+        return;
+    }
+
+    // Framebuffer pixels, bottom-up like the recorded rects
+    glState.Viewport(0, 0, state.size.width, state.size.height);
+    glState.Enable(GL_SCISSOR_TEST);
+
+    GlCommandBackend backend = { clip, state.size, 0 };
+    for (uint32_t i = 0; i < layerCount; ++i)
+    {
+        layers[i]->Replay(backend);
+    }
+
+    backend.Flush();
+    glState.Disable(GL_SCISSOR_TEST);
+}
+
+void SimulateRenderCost()
+{
+    if (!software) glFinish();
+    Uint64 end = SDL_GetPerformanceCounter() + SDL_GetPerformanceFrequency() * renderCost / 1000;
+    while (SDL_GetPerformanceCounter() < end) YieldProcessor();
+}
+
+// Redraws whatever changed since the last frame and presents it; returns false when nothing did
+bool DrawFrame(const FrameState& state)
+{
+    RasterRect damage = FrameDamage(state);
+    if (RasterEmpty(damage)) return false;
+
+    if (framebuffer)
+    {
+        // The back slot holds an older frame, so it needs everything that changed since then. The GL
+        // framebuffer is always current and only redraws this frame's damage before reading back.
+        RasterRect transfer = RasterUnion(damage, SlotDamage(backBuffer.Back()));
+        RenderScene(state, software ? transfer : damage);
+        if (renderCost > 0) SimulateRenderCost();
+        PublishFrame(damage, transfer);
+    }
+    else
+    {
+        // A window's back buffer is undefined after swapping
+        RenderScene(state, { 0, 0, state.size.width, state.size.height });
+        if (renderCost > 0) SimulateRenderCost();
+        SDL_GL_SwapWindow(window);
+    }
+
+    lastFrame = state;
+    lastFrameValid = true;
+    return true;
+}
+
+bool WriteFrame(const char* prefix, uint32_t index, uint32_t slot)
+{
+    // Binary PPM, top-down RGB
+    char path[MAX_PATH];
+    SDL_snprintf(path, sizeof(path), "%s%05u.ppm", prefix, index);
+
+    SDL_RWops* file = SDL_RWFromFile(path, "wb");
+    if (file == nullptr)
+    {
+        SDL_Log("Unable to write %s: %s", path, SDL_GetError());
+        return false;
+    }
+
+    const FramebufferSlot& frame = framebuffer->slots[slot];
+    const uint8_t* pixels = FramebufferPixels(framebuffer, slot);
+
+    char header[64];
+    int length = SDL_snprintf(header, sizeof(header), "P6\n%d %d\n255\n", frame.width, frame.height);
+    SDL_RWwrite(file, header, 1, length);
+
+    std::vector<uint8_t> row(frame.width * 3);
+    for (int32_t y = frame.height - 1; y >= 0; --y)
+    {
+        const uint8_t* bgra = pixels + (size_t)y * frame.width * 4;
+        for (int32_t x = 0; x < frame.width; ++x)
+        {
+            row[x * 3 + 0] = bgra[x * 4 + 2];
+            row[x * 3 + 1] = bgra[x * 4 + 1];
+            row[x * 3 + 2] = bgra[x * 4 + 0];
+        }
+        SDL_RWwrite(file, row.data(), 1, row.size());
+    }
+
+    SDL_RWclose(file);
+    return true;
+}
+
+// Renders a fixed number of frames without Parent, e.g. Child -headless -frames 600 -size 1280x720 -out frame [-software [-threads N]]
+// -record saves the commands of the last frame, -replay draws a saved command buffer instead of the scene
+int RunHeadless(int argc, char* argv[])
+{
+    uint32_t threads = 0;
+    uint32_t frames = CHILD_HEADLESS_FRAMES;
+    ChildSize size = { CHILD_HEADLESS_WIDTH, CHILD_HEADLESS_HEIGHT };
+    const char* prefix = nullptr;
+    const char* recordPath = nullptr;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)SDL_max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+        {
+            if (SDL_sscanf(argv[++i], "%dx%d", &size.width, &size.height) != 2 || size.width <= 0 || size.height <= 0)
+            {
+                SDL_Log("Invalid size %s, expected WIDTHxHEIGHT", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-out") == 0 && i + 1 < argc)
+        {
+            prefix = argv[++i];
+        }
+        else if (strcmp(argv[i], "-software") == 0)
+        {
+            software = true;
+        }
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            threads = (uint32_t)SDL_max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-record") == 0 && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc)
+        {
+            if (!replayCommands.Load(argv[++i])) return 1;
+            replaying = true;
+            SDL_Log("Replaying %u commands from %s", replayCommands.Commands(), argv[i]);
+        }
+    }
+
+    if (software)
+    {
+        tileRenderer = new TileRenderer(threads);
+        SDL_Log("Rendering headless with %s kernels on %u threads", SelectRasterKernels()->name, tileRenderer->Threads());
+    }
+    else
+    {
+        if (SDL_Init(SDL_INIT_VIDEO) != 0)
+        {
+            SDL_Log("Failed to initialize SDL: %s", SDL_GetError());
+            return 1;
+        }
+
+        // A hidden window only provides the GL context; without a GPU, opengl32 falls back to a software renderer
+        window = SDL_CreateWindow("Child", 0, 0, size.width, size.height, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+        context = window ? SDL_GL_CreateContext(window) : nullptr;
+
+        if (context == nullptr)
+        {
+            SDL_Log("Unable to create OpenGL context: %s", SDL_GetError());
+            return 1;
+        }
+
+        SDL_GL_MakeCurrent(window, context);
+        glState.Initialize();
+        programCache.Initialize();
+        quadBatch.Initialize(&glState, nullptr, QuadBackend::Instanced, &programCache);
+        SDL_Log("Rendering headless with %s, %s quads", (const char*)glGetString(GL_RENDERER), quadBatch.BackendName());
+    }
+
+    // Same slot layout as Parent's shared framebuffer, just private to this process
+    framebuffer = (FramebufferHeader*)VirtualAlloc(nullptr, FramebufferMappingSize(size.width, size.height), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (framebuffer == nullptr)
+    {
+        SDL_Log("Unable to allocate framebuffer: %s", LastErrorMessage().c_str());
+        return 1;
+    }
+
+    InitializeTripleBuffer(&framebuffer->middle);
+    framebuffer->maxWidth = size.width;
+    framebuffer->maxHeight = size.height;
+    backBuffer = TripleBufferWriter(&framebuffer->middle);
+
+    if (!software && !CreateFramebuffer())
+    {
+        return 1;
+    }
+
+    ResizeFramebuffer(size);
+
+    // Advance exactly one tick per frame so runs are reproducible, and swap colors once per simulated second
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 renderCounter = 0;
+    Uint64 writeCounter = 0;
+
+    for (uint32_t i = 0; i < frames; ++i)
+    {
+        if (i % CHILD_TICK_RATE == 0)
+        {
+            GLfloat red = targetScene.color[0];
+            targetScene.color[0] = targetScene.color[1];
+            targetScene.color[1] = red;
+        }
+
+        UpdateScene(1.0 / CHILD_TICK_RATE);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        // No document loads headless, so its view is complete and draws no progress bar
+        DrawFrame({ currentScene, { 0, 0, 0, 0 }, framebufferSize, 0, { documentGeneration, 0, 1000 } });
+        Uint64 rendered = SDL_GetPerformanceCounter();
+        renderCounter += rendered - start;
+
+        // Unchanged frames repeat the last published one
+        if (prefix != nullptr)
+        {
+            if (!WriteFrame(prefix, i, publishedSlot)) return 1;
+            writeCounter += SDL_GetPerformanceCounter() - rendered;
+        }
+    }
+
+    double renderMs = (double)renderCounter * 1000.0 / (double)frequency;
+    SDL_Log("Rendered %u frames at %dx%d in %.1f ms, %.1f frames/s, %.0f pixels rendered and %.0f transferred per frame",
+            frames, framebufferSize.width, framebufferSize.height, renderMs, frames * 1000.0 / renderMs,
+            (double)renderedPixels / frames, (double)transferredPixels / frames);
+    SDL_Log("Recorded %u of %u replayed layers", layersRecorded, layersReplayed);
+    if (!software) SDL_Log("GL state calls: %llu issued, %llu elided", (unsigned long long)glState.Issued(), (unsigned long long)glState.Elided());
+
+    if (recordPath != nullptr && !replaying)
+    {
+        CommandBuffer scene;
+        scene.Append(backgroundLayer.commands);
+        scene.Append(documentLayer.commands);
+        scene.Append(markerLayer.commands);
+        if (!scene.Save(recordPath)) return 1;
+        SDL_Log("Saved %u commands with hash %016llx to %s", scene.Commands(), (unsigned long long)scene.Hash(), recordPath);
+    }
+
+    if (prefix != nullptr)
+    {
+        SDL_Log("Wrote %u frames in %.1f ms", frames, (double)writeCounter * 1000.0 / (double)frequency);
+    }
+
+    delete tileRenderer;
+    VirtualFree(framebuffer, 0, MEM_RELEASE);
+    SDL_DestroyMutex(documentLock);
+
+    // The software path never initialized SDL video
+    if (!software)
+    {
+        quadBatch.Release();
+        glDeleteRenderbuffers(1, &colorbuffer);
+        glDeleteFramebuffers(1, &fbo);
+
+        SDL_GL_DeleteContext(context);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+    }
+
+    return 0;
+}
+
+// Runs a GL benchmark offscreen through the same framebuffer object as headless mode
+template <typename Benchmark>
+int RunGlBenchmark(ChildSize size, Benchmark benchmark)
 {
-    DWORD id = GetLastError();
-    if (id == 0) return std::string();
+    if (SDL_Init(SDL_INIT_VIDEO) != 0)
+    {
+        SDL_Log("Failed to initialize SDL: %s", SDL_GetError());
+        return 1;
+    }
 
-    LPSTR buffer = nullptr;
-    size_t size = FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, 
-                                 nullptr, id, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPSTR)&buffer, 0, nullptr);
+    window = SDL_CreateWindow("Child", 0, 0, size.width, size.height, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    context = window ? SDL_GL_CreateContext(window) : nullptr;
 
-    std::string message(buffer, size);
-    LocalFree(buffer);
-    return message;
+    if (context == nullptr)
+    {
+        SDL_Log("Unable to create OpenGL context: %s", SDL_GetError());
+        return 1;
+    }
+
+    SDL_GL_MakeCurrent(window, context);
+    glState.Initialize();
+
+    if (!CreateFramebuffer())
+    {
+        return 1;
+    }
+
+    AllocateStorage(size);
+    glState.Viewport(0, 0, size.width, size.height);
+    benchmark(size);
+
+    glDeleteRenderbuffers(1, &colorbuffer);
+    glDeleteFramebuffers(1, &fbo);
+    SDL_GL_DeleteContext(context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
+}
+
+int RenderThread(void*)
+{
+    // The render thread owns the GL context from here on; the shadow state may not match it anymore
+    SDL_GL_MakeCurrent(window, context);
+    glState.Invalidate();
+
+    FrameScheduler scheduler(frameRate, CHILD_TICK_RATE);
+    TripleBufferReader reader(&snapshotMiddle);
+    bool firstFrame = true;
+
+    Uint32 statsTime = SDL_GetTicks();
+    uint32_t statsFrames = 0;
+    uint32_t statsPublished = 0;
+
+    while (running)
+    {
+        bool fresh = reader.Acquire();
+        const Snapshot& snapshot = snapshots[reader.Front()];
+
+        bool trimPending = false;
+
+        if (framebuffer)
+        {
+            if (snapshot.size.width != requestedSize.width || snapshot.size.height != requestedSize.height)
+            {
+                ResizeFramebuffer(snapshot.size);
+            }
+
+            trimPending = TrimFramebuffer();
+        }
+
+        // Nothing changed since the last frame; sleep until the update thread publishes or the size settles
+        if (onDemand && !fresh && !snapshot.animating && !firstFrame)
+        {
+            WaitForSingleObject(renderEvent, trimPending ? CHILD_RESIZE_SETTLE_MS : INFINITE);
+            scheduler.Reset();
+            continue;
+        }
+
+        FrameState state;
+        state.scene = InterpolateScene(snapshot);
+        state.size = framebufferSize;
+        state.exposures = snapshot.exposures;
+        state.document = snapshot.document;
+
+        // An embedded window grows ahead of a resize; Parent shows only the requested size from its bottom left
+        if (!framebuffer)
+        {
+            SDL_GL_GetDrawableSize(window, &state.size.width, &state.size.height);
+            state.size.width = SDL_min(state.size.width, snapshot.size.width);
+            state.size.height = SDL_min(state.size.height, snapshot.size.height);
+        }
+
+        state.marker = MarkerRect(snapshot.pointer, state.size);
+
+        statsPublished += DrawFrame(state) ? 1 : 0;
+        statsFrames++;
+
+        Uint32 elapsed = SDL_GetTicks() - statsTime;
+        if (elapsed >= 1000)
+        {
+            double pixels = (double)statsFrames * state.size.width * state.size.height;
+            SDL_Log("Drew %.1f of %.1f frames/s at %dx%d, %.0f pixels rendered and %.0f transferred per frame, %.1f%% of full redraws, "
+                    "%u of %u layers recorded",
+                    statsPublished * 1000.0 / elapsed, statsFrames * 1000.0 / elapsed, state.size.width, state.size.height,
+                    renderedPixels / (double)statsFrames, transferredPixels / (double)statsFrames, renderedPixels * 100.0 / pixels,
+                    layersRecorded, layersReplayed);
+
+            if (!software && statsPublished > 0)
+            {
+                SDL_Log("GL state calls per drawn frame: %.1f issued, %.1f elided, %.1f draw calls for %.1f quads",
+                        glState.Issued() / (double)statsPublished, glState.Elided() / (double)statsPublished,
+                        quadBatch.DrawCalls() / (double)statsPublished, quadBatch.Quads() / (double)statsPublished);
+            }
+
+            glState.ResetCounters();
+            quadBatch.ResetCounters();
+            statsTime = SDL_GetTicks();
+            statsFrames = 0;
+            statsPublished = 0;
+            renderedPixels = 0;
+            transferredPixels = 0;
+            layersRecorded = 0;
+            layersReplayed = 0;
+        }
+
+        if (firstFrame)
+        {
+            double ms = (double)(SDL_GetPerformanceCounter() - adoptCounter) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+            SDL_Log("Adopted after %u ms parked, first frame in %.2f ms", parkedTicks, ms);
+            firstFrame = false;
+        }
+
+        scheduler.WaitForNextFrame();
+    }
+
+    SDL_GL_MakeCurrent(window, nullptr);
+    return 0;
+}
+
+// Arguments arrive as UTF-8; file names go to Win32 as UTF-16
+static std::wstring WideArgument(const char* argument)
+{
+    int length = MultiByteToWideChar(CP_UTF8, 0, argument, -1, nullptr, 0);
+    std::wstring wide(length > 1 ? length - 1 : 0, L'\0');
+    if (length > 1) MultiByteToWideChar(CP_UTF8, 0, argument, -1, &wide[0], length);
+    return wide;
 }
 
 int main(int argc, char* argv[])
 {
-    long parentPID = 0;
+    Uint64 startCounter = SDL_GetPerformanceCounter();
+
+    // Headless frames record the document layer too, so both paths need the lock
+    documentLock = SDL_CreateMutex();
+
+    if (argc > 1 && strcmp(argv[1], "-headless") == 0)
+    {
+        return RunHeadless(argc, argv);
+    }
+
+    // Compare the rasterizer kernels, e.g. Child -benchraster 1920x1080
+    if (argc > 1 && strcmp(argv[1], "-benchraster") == 0)
+    {
+        ChildSize size = { CHILD_HEADLESS_WIDTH, CHILD_HEADLESS_HEIGHT };
+        if (argc > 2) SDL_sscanf(argv[2], "%dx%d", &size.width, &size.height);
+        BenchmarkRasterKernels(SDL_max(1, size.width), SDL_max(1, size.height));
+        return 0;
+    }
+
+    // Record and replay cost of a command buffer, e.g. Child -benchcommands 100000
+    if (argc > 1 && strcmp(argv[1], "-benchcommands") == 0)
+    {
+        BenchmarkCommandBuffer(argc > 2 ? (uint32_t)SDL_max(1, atoi(argv[2])) : 100000);
+        return 0;
+    }
+
+    // Draw calls and frame times of the quad batch backends, e.g. Child -benchquads 1920x1080
+    if (argc > 1 && strcmp(argv[1], "-benchquads") == 0)
+    {
+        ChildSize size = { CHILD_HEADLESS_WIDTH, CHILD_HEADLESS_HEIGHT };
+        if (argc > 2) SDL_sscanf(argv[2], "%dx%d", &size.width, &size.height);
+        return RunGlBenchmark({ SDL_max(1, size.width), SDL_max(1, size.height) },
+                              [](ChildSize size) { BenchmarkQuadBatch(glState, size.width, size.height); });
+    }
+
+    // Quad batch startup without, with a cold and with a warm program cache, e.g. Child -benchprograms 10
+    if (argc > 1 && strcmp(argv[1], "-benchprograms") == 0)
+    {
+        uint32_t rounds = argc > 2 ? (uint32_t)SDL_max(1, atoi(argv[2])) : 10;
+        return RunGlBenchmark({ CHILD_HEADLESS_WIDTH, CHILD_HEADLESS_HEIGHT }, [rounds](ChildSize) { BenchmarkProgramCache(glState, rounds); });
+    }
+
+    // Layout and atlas cost of changing against static labels, e.g. Child -benchtext 1920x1080
+    if (argc > 1 && strcmp(argv[1], "-benchtext") == 0)
+    {
+        ChildSize size = { CHILD_HEADLESS_WIDTH, CHILD_HEADLESS_HEIGHT };
+        if (argc > 2) SDL_sscanf(argv[2], "%dx%d", &size.width, &size.height);
+        BenchmarkTextRenderer(SDL_max(1, size.width), SDL_max(1, size.height));
+        return 0;
+    }
+
+    // Atlas residency of 40k small images under a memory budget in MB, e.g. Child -benchtextures 16
+    if (argc > 1 && strcmp(argv[1], "-benchtextures") == 0)
+    {
+        BenchmarkTextureManager(argc > 2 ? (uint32_t)SDL_max(0, atoi(argv[2])) : 0);
+        return 0;
+    }
+
+    // Compile a document into a pack that opens without parsing, e.g. Child -compile big.txt
+    if (argc > 2 && strcmp(argv[1], "-compile") == 0)
+    {
+        std::wstring source = WideArgument(argv[2]);
+        std::wstring pack = argc > 3 ? WideArgument(argv[3]) : source + DOCUMENT_PACK_EXTENSION;
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (!CompileDocument(source.c_str(), pack.c_str())) return 1;
+
+        SDL_Log("Compiled %s in %.0f ms", argc > 3 ? argv[3] : argv[2], (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+        return 0;
+    }
+
+    // Open to first frame of a document against its pack, e.g. Child -benchpack 1024
+    if (argc > 1 && strcmp(argv[1], "-benchpack") == 0)
+    {
+        BenchmarkDocumentPack(argc > 2 ? (uint32_t)SDL_max(0, atoi(argv[2])) : 0);
+        return 0;
+    }
+
+    // Reload time against the share of a document edited, e.g. Child -benchreload 1024
+    if (argc > 1 && strcmp(argv[1], "-benchreload") == 0)
+    {
+        BenchmarkDocumentReload(argc > 2 ? (uint32_t)SDL_max(0, atoi(argv[2])) : 0);
+        return 0;
+    }
+
+    // Frame times while a document loads in the background, e.g. Child -benchload 1024
+    if (argc > 1 && strcmp(argv[1], "-benchload") == 0)
+    {
+        BenchmarkDocumentLoader(argc > 2 ? (uint32_t)SDL_max(0, atoi(argv[2])) : 0);
+        return 0;
+    }
+
+    // Open time and working set of mapped documents against reading them, e.g. Child -benchopen 1024
+    if (argc > 1 && strcmp(argv[1], "-benchopen") == 0)
+    {
+        BenchmarkDocument(argc > 2 ? (uint32_t)SDL_max(0, atoi(argv[2])) : 0);
+        return 0;
+    }
+
+    // Thread scaling of the tile renderer, at 1080p and 4K unless a size is given
+    if (argc > 1 && strcmp(argv[1], "-benchtiles") == 0)
+    {
+        ChildSize size = { 0, 0 };
+        if (argc > 2 && SDL_sscanf(argv[2], "%dx%d", &size.width, &size.height) == 2 && size.width > 0 && size.height > 0)
+        {
+            BenchmarkTileRenderer(size.width, size.height);
+        }
+        else
+        {
+            BenchmarkTileRenderer(1920, 1080);
+            BenchmarkTileRenderer(3840, 2160);
+        }
+        return 0;
+    }
+
+    // Get handshake pipe inherited from parent
+    HANDLE pipe = NULL;
 
     if (argc > 1)
     {
-        parentPID = atol(argv[1]);
+        pipe = (HANDLE)(ULONG_PTR)_strtoui64(argv[1], nullptr, 10);
     }
 
-    if (parentPID == 0)
+    if (pipe == NULL)
     {
-        SDL_Log("Unable to find parent PID");
+        SDL_Log("Unable to find handshake pipe");
         return 1;
     }
 
-    // Find parent window handle
-    HWND hwndParent = FindWindow(L"Parent", NULL);
+    // Read hello from parent
+    ChildHello hello;
+    DWORD read = 0;
 
-    if (hwndParent == NULL)
+    if (!ReadFile(pipe, &hello, sizeof(ChildHello), &read, nullptr) || read != sizeof(ChildHello))
     {
-        SDL_Log("%s", LastErrorMessage());
+        SDL_Log("Unable to read hello from parent: %s", LastErrorMessage().c_str());
         return 1;
     }
 
-    // Find parent process id
-    DWORD lpdwProcessId;
-    GetWindowThreadProcessId(hwndParent, &lpdwProcessId);
-
-    if (lpdwProcessId != parentPID)
+    if (hello.magic != CHILD_PROTOCOL_MAGIC || hello.version != CHILD_PROTOCOL_VERSION || hello.size != sizeof(ChildHello))
     {
-        SDL_Log("Unable to find parent window with PID %l", parentPID);
+        SDL_Log("Unsupported hello from parent (version %u, size %u)", hello.version, hello.size);
         return 1;
     }
 
-    // Get parent client rect
-    RECT pcr;
-    if (GetWindowRect(hwndParent, &pcr) == 0)
+    HWND hwndParent = (HWND)(ULONG_PTR)hello.parentWindow;
+
+    // Map command and reply rings shared with parent
+    channel = (ChildChannel*)MapViewOfFile((HANDLE)(ULONG_PTR)hello.channel, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ChildChannel));
+
+    if (channel == nullptr)
     {
-        SDL_Log("%s", LastErrorMessage());
+        SDL_Log("Unable to map parent channel: %s", LastErrorMessage().c_str());
         return 1;
     }
 
-    // Initialize SDL
-    if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
+    commands = Ring(&channel->commands, channel->commandData, CHILD_RING_CAPACITY);
+    replies = Ring(&channel->replies, channel->replyData, CHILD_RING_CAPACITY);
+    replyEvent = (HANDLE)(ULONG_PTR)hello.replyEvent;
+    commandEvent = (HANDLE)(ULONG_PTR)hello.commandEvent;
+    onDemand = (hello.capabilities & CHILD_CAPABILITY_ON_DEMAND) != 0;
+    software = (hello.capabilities & CHILD_CAPABILITY_SOFTWARE) && (hello.capabilities & CHILD_CAPABILITY_FRAMEBUFFER);
+    frameRate = hello.frameRate;
+    renderCost = hello.renderCost;
+    viewSize = { hello.width, hello.height };
+
+    double attachMs = (double)(SDL_GetPerformanceCounter() - startCounter) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+    SDL_Log("Attached to parent %u in %.3f ms", hello.parentProcessId, attachMs);
+
+    // Initialize only the video subsystem; audio, joystick and haptic enumeration dominate startup and are unused
+    if (SDL_Init(SDL_INIT_VIDEO) != 0)
     {
         const char* err = SDL_GetError();
         SDL_Log("Failed to initialize SDL: %s", SDL_GetError());
         return 1;
     }
 
-    // Create SDL window and attach OpenGL context
-    window = SDL_CreateWindow("Child", 0, 0, pcr.right - pcr.left, pcr.bottom - pcr.top, SDL_WINDOW_OPENGL | SDL_WINDOW_BORDERLESS);
-    context = SDL_GL_CreateContext(window);
+    // Create SDL window and attach OpenGL context unless rendering on the CPU
+    // The window starts hidden; Parent shows it when the child is adopted from its pool
+    Uint32 windowFlags = SDL_WINDOW_BORDERLESS | SDL_WINDOW_HIDDEN | (software ? 0 : SDL_WINDOW_OPENGL);
+    window = SDL_CreateWindow("Child", 0, 0, hello.width, hello.height, windowFlags);
+    context = software ? nullptr : SDL_GL_CreateContext(window);
 
     // Get SDL window handle
     SDL_VERSION(&sysinfo.version);
@@ -100,19 +1507,125 @@ int main(int argc, char* argv[])
     }
 
     // Set SDL window as child to native parent window
-    if (!SetParent(hwndChild, hwndParent))
+    if ((hello.capabilities & CHILD_CAPABILITY_EMBED) && !SetParent(hwndChild, hwndParent))
     {
-        SDL_Log("%s", LastErrorMessage());
+        SDL_Log("%s", LastErrorMessage().c_str());
         return 1;
     }
 
     // Set up OpenGL context for rendering
     SDL_GL_MakeCurrent(window, context);
 
-    GLfloat color[4] = { 0.2f, 0.4f, 0.1f, 1.0f };
+    if (context)
+    {
+        // Shader compilation dominates here unless the program cache has a binary from an earlier start
+        Uint64 glStart = SDL_GetPerformanceCounter();
+        glState.Initialize();
+        programCache.Initialize();
+        quadBatch.Initialize(&glState, nullptr, QuadBackend::Instanced, &programCache);
+
+        double glMs = (double)(SDL_GetPerformanceCounter() - glStart) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+        SDL_Log("Drawing quads with %s, ready in %.2f ms (%u programs loaded, %u compiled)", quadBatch.BackendName(), glMs,
+                programCache.Hits(), programCache.Misses());
+    }
+
+    // Map shared framebuffer
+    if (hello.capabilities & CHILD_CAPABILITY_FRAMEBUFFER)
+    {
+        framebuffer = (FramebufferHeader*)MapViewOfFile((HANDLE)(ULONG_PTR)hello.framebuffer, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+        if (framebuffer == nullptr)
+        {
+            SDL_Log("Unable to map shared framebuffer: %s", LastErrorMessage().c_str());
+            return 1;
+        }
+
+        if (!software && !CreateFramebuffer())
+        {
+            return 1;
+        }
+
+        backBuffer = TripleBufferWriter(&framebuffer->middle);
+        ResizeFramebuffer({ hello.width, hello.height });
+    }
+
+    // Report ready and park until Parent adopts this child by showing its window, or with a command in framebuffer mode
+    UINT childReadyMessage = RegisterWindowMessage(L"ParentChildReady");
+    PostMessage(hwndParent, childReadyMessage, (WPARAM)hwndChild, (LPARAM)GetCurrentProcessId());
+
+    Uint32 parkTime = SDL_GetTicks();
+
+    while (parked && running)
+    {
+        WaitForWork(INFINITE);
+
+        SDL_Event event;
+        while (SDL_PollEvent(&event))
+        {
+            if (event.type == SDL_QUIT)
+            {
+                running = false;
+            }
+            else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SHOWN)
+            {
+                parked = false;
+            }
+        }
+
+        HandleCommands();
+        UpdateDocument();
+        NotifyParent();
+    }
+
+    parkedTicks = SDL_GetTicks() - parkTime;
+    adoptCounter = SDL_GetPerformanceCounter();
+
+    // Tile workers start on adoption; a pool of parked software children would otherwise hold one thread per core each
+    if (software)
+    {
+        tileRenderer = new TileRenderer(hello.renderThreads);
+        SDL_Log("Rendering with %s kernels on %u threads", SelectRasterKernels()->name, tileRenderer->Threads());
+    }
+
+    // Hand the GL context over to the render thread; this thread keeps events, commands and simulation
+    for (Snapshot& snapshot : snapshots)
+    {
+        snapshot = { previousScene, currentScene, SDL_GetPerformanceCounter(), viewSize, false, pointer, exposures,
+                     { documentGeneration, 0, 1000 } };
+    }
+
+    InitializeTripleBuffer(&snapshotMiddle);
+    snapshotWriter = TripleBufferWriter(&snapshotMiddle);
+    renderEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    SDL_GL_MakeCurrent(window, nullptr);
+
+    SDL_Thread* renderThread = SDL_CreateThread(RenderThread, "Render", nullptr);
+
+    if (!renderThread)
+    {
+        SDL_Log("Unable to start render thread: %s", SDL_GetError());
+        return 1;
+    }
+
+    FrameScheduler scheduler(0, CHILD_TICK_RATE);
+    ReportCpuUsage();
+    latencyReportTime = SDL_GetTicks();
+    SDL_AddEventWatch(StampInput, nullptr);
 
     while (running)
     {
+        // Sleep until input, a command, the next tick while animating or the next report
+        Uint32 timeout = ReportCpuUsage();
+        bool animating = SceneAnimating();
+        if (animating) timeout = SDL_min(timeout, scheduler.UntilNextTick());
+
+        if (!dirty)
+        {
+            WaitForWork(timeout);
+        }
+
+        if (!animating) scheduler.Reset();
+
         SDL_Event event;
         while (SDL_PollEvent(&event))
         {
@@ -122,19 +1635,82 @@ int main(int argc, char* argv[])
             }
             else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_SPACE)
             {
-                GLfloat red = color[0];
-                color[0] = color[1];
-                color[1] = red;
+                GLfloat red = targetScene.color[0];
+                targetScene.color[0] = targetScene.color[1];
+                targetScene.color[1] = red;
+                dirty = true;
+            }
+            else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED)
+            {
+                exposures++;
+                dirty = true;
+            }
+            else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+            {
+                dirty = true;
             }
+            else if (event.type == SDL_MOUSEMOTION)
+            {
+                // Rows above the part of an embedded window Parent shows are hidden
+                int windowHeight = viewSize.height;
+                if (!framebuffer) SDL_GetWindowSize(window, nullptr, &windowHeight);
+                pointer = { event.motion.x, event.motion.y - SDL_max(0, windowHeight - viewSize.height) };
+                dirty = true;
+            }
+            else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_LEAVE)
+            {
+                pointer = { -1, -1 };
+                dirty = true;
+            }
+
+            if (IsInputEvent(event)) RecordInputLatency(event);
         }
 
-        glClearColor(color[0], color[1], color[2], color[3]);
-        glClear(GL_COLOR_BUFFER_BIT);
+        HandleCommands();
+        UpdateDocument();
 
-        SDL_GL_SwapWindow(window);
-        SDL_Delay(1);
+        // Advance the simulation in fixed ticks, independent of the frame rate
+        uint32_t ticks = scheduler.BeginFrame();
+        for (uint32_t i = 0; i < ticks; ++i)
+        {
+            UpdateScene(scheduler.TickSeconds());
+        }
+
+        if (ticks > 0 && animating) dirty = true;
+
+        if (dirty)
+        {
+            PublishSnapshot(scheduler.TickCounter());
+            dirty = false;
+        }
+
+        NotifyParent();
+        ReportLatency();
+    }
+
+    SetEvent(renderEvent);
+    SDL_WaitThread(renderThread, nullptr);
+    CloseHandle(renderEvent);
+    documentLoader.Cancel();
+    SDL_DestroyMutex(documentLock);
+
+    SDL_GL_MakeCurrent(window, context);
+    if (context) quadBatch.Release();
+
+    if (framebuffer)
+    {
+        if (!software)
+        {
+            glDeleteRenderbuffers(1, &colorbuffer);
+            glDeleteFramebuffers(1, &fbo);
+        }
+
+        delete tileRenderer;
+        UnmapViewOfFile(framebuffer);
     }
 
+    UnmapViewOfFile(channel);
+
     SDL_GL_DeleteContext(context);
     SDL_DestroyWindow(window);
     SDL_Quit();
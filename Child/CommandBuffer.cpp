@@ -0,0 +1,279 @@
+#include "CommandBuffer.h"
+
+#include <string.h>
+
+#include <SDL.h>
+
+#include "TileRenderer.h"
+
+uint64_t CommandHash(const void* data, size_t size, uint64_t seed)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = seed;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+void CommandBuffer::Clear()
+{
+    data.clear();
+    commandCount = 0;
+    hashValid = false;
+}
+
+void CommandBuffer::Fill(RasterRect rect, uint32_t color)
+{
+    Record(DrawCommandType::Fill, FillCommand{ rect, color });
+}
+
+void CommandBuffer::FillGradient(RasterRect rect, uint32_t left, uint32_t right)
+{
+    Record(DrawCommandType::Gradient, GradientCommand{ rect, left, right });
+}
+
+void CommandBuffer::Blend(RasterRect rect, uint32_t color)
+{
+    Record(DrawCommandType::Blend, BlendCommand{ rect, color });
+}
+
+void CommandBuffer::DrawImage(RasterRect rect, uint32_t texture)
+{
+    Record(DrawCommandType::Image, ImageCommand{ rect, texture });
+}
+
+void CommandBuffer::Append(const CommandBuffer& other)
+{
+    data.insert(data.end(), other.data.begin(), other.data.end());
+    commandCount += other.commandCount;
+    hashValid = false;
+}
+
+template <typename Command>
+void CommandBuffer::Record(DrawCommandType type, const Command& command)
+{
+    // Payloads are whole 32-bit words, so every record stays aligned
+    static_assert(sizeof(Command) % sizeof(uint32_t) == 0, "payload must be a multiple of 4 bytes");
+
+    size_t offset = data.size();
+    data.resize(offset + sizeof(uint32_t) + sizeof(Command));
+    *(uint32_t*)&data[offset] = (uint32_t)type;
+    memcpy(&data[offset + sizeof(uint32_t)], &command, sizeof(Command));
+
+    commandCount++;
+    hashValid = false;
+}
+
+size_t CommandBuffer::PayloadSize(uint32_t type)
+{
+    switch ((DrawCommandType)type)
+    {
+        case DrawCommandType::Fill: return sizeof(FillCommand);
+        case DrawCommandType::Gradient: return sizeof(GradientCommand);
+        case DrawCommandType::Blend: return sizeof(BlendCommand);
+        case DrawCommandType::Image: return sizeof(ImageCommand);
+    }
+    return 0;
+}
+
+uint64_t CommandBuffer::Hash() const
+{
+    if (!hashValid)
+    {
+        hash = CommandHash(data.data(), data.size());
+        hashValid = true;
+    }
+    return hash;
+}
+
+void CommandBuffer::Replay(TileRenderer& renderer, const RasterImage* const* textures, uint32_t textureCount) const
+{
+    struct Backend
+    {
+        TileRenderer& renderer;
+        const RasterImage* const* textures;
+        uint32_t textureCount;
+
+        void Fill(RasterRect rect, uint32_t color) { renderer.Fill(rect, color); }
+        void FillGradient(RasterRect rect, uint32_t left, uint32_t right) { renderer.FillGradient(rect, left, right); }
+        void Blend(RasterRect rect, uint32_t color) { renderer.Blend(rect, color); }
+
+        void DrawImage(RasterRect rect, uint32_t texture)
+        {
+            if (texture < textureCount) renderer.DrawImage(rect, textures[texture]);
+        }
+    };
+
+    Backend backend = { renderer, textures, textureCount };
+    Replay(backend);
+}
+
+bool CommandBuffer::Assign(const void* records, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)records;
+    uint32_t commands = 0;
+
+    // Every record must have a known type and fit entirely
+    for (size_t offset = 0; offset < size; commands++)
+    {
+        if (size - offset < sizeof(uint32_t)) return false;
+
+        uint32_t type;
+        memcpy(&type, bytes + offset, sizeof(uint32_t));
+        size_t payload = PayloadSize(type);
+
+        if (payload == 0 || size - offset - sizeof(uint32_t) < payload) return false;
+        offset += sizeof(uint32_t) + payload;
+    }
+
+    data.assign(bytes, bytes + size);
+    commandCount = commands;
+    hashValid = false;
+    return true;
+}
+
+bool CommandBuffer::Save(const char* path) const
+{
+    SDL_RWops* file = SDL_RWFromFile(path, "wb");
+    if (file == nullptr)
+    {
+        SDL_Log("Unable to write %s: %s", path, SDL_GetError());
+        return false;
+    }
+
+    CommandBufferHeader header = { COMMAND_BUFFER_MAGIC, COMMAND_BUFFER_VERSION, commandCount, (uint32_t)data.size(), Hash() };
+    bool written = SDL_RWwrite(file, &header, sizeof(header), 1) == 1 &&
+                   (data.empty() || SDL_RWwrite(file, data.data(), data.size(), 1) == 1);
+
+    SDL_RWclose(file);
+    if (!written) SDL_Log("Unable to write %s: %s", path, SDL_GetError());
+    return written;
+}
+
+bool CommandBuffer::Load(const char* path)
+{
+    SDL_RWops* file = SDL_RWFromFile(path, "rb");
+    if (file == nullptr)
+    {
+        SDL_Log("Unable to read %s: %s", path, SDL_GetError());
+        return false;
+    }
+
+    CommandBufferHeader header;
+    std::vector<uint8_t> records;
+    bool read = SDL_RWread(file, &header, sizeof(header), 1) == 1 &&
+                header.magic == COMMAND_BUFFER_MAGIC && header.version == COMMAND_BUFFER_VERSION;
+
+    if (read)
+    {
+        records.resize(header.size);
+        read = header.size == 0 || SDL_RWread(file, records.data(), header.size, 1) == 1;
+    }
+
+    SDL_RWclose(file);
+
+    if (!read || !Assign(records.data(), records.size()) || Hash() != header.hash || commandCount != header.commands)
+    {
+        SDL_Log("%s is not a valid command buffer", path);
+        Clear();
+        return false;
+    }
+    return true;
+}
+
+void BenchmarkCommandBuffer(uint32_t count)
+{
+    const uint32_t rounds = 10;
+
+    // The scene being traversed: what a recording pass reads to emit its commands
+    struct Shape
+    {
+        DrawCommandType type;
+        RasterRect rect;
+        uint32_t color;
+        uint32_t color2;
+    };
+
+    std::vector<Shape> shapes(count);
+    uint32_t seed = 12345;
+    auto next = [&seed](uint32_t range) { seed = seed * 1664525 + 1013904223; return (seed >> 8) % range; };
+
+    for (Shape& shape : shapes)
+    {
+        shape.type = (DrawCommandType)(next(4) + 1);
+        shape.rect = { (int32_t)next(1920), (int32_t)next(1080), (int32_t)next(256) + 1, (int32_t)next(256) + 1 };
+        shape.color = 0xFF000000 | next(0xFFFFFF);
+        shape.color2 = 0xFF000000 | next(0xFFFFFF);
+    }
+
+    // Sums every argument so replay cannot be optimized away and can be checked against the scene
+    struct Checksum
+    {
+        uint64_t sum;
+
+        void Add(RasterRect rect, uint32_t a, uint32_t b) { sum = sum * 31 + rect.x + rect.y + rect.width + rect.height + a + b; }
+        void Fill(RasterRect rect, uint32_t color) { Add(rect, color, 0); }
+        void FillGradient(RasterRect rect, uint32_t left, uint32_t right) { Add(rect, left, right); }
+        void Blend(RasterRect rect, uint32_t color) { Add(rect, color, 0); }
+        void DrawImage(RasterRect rect, uint32_t texture) { Add(rect, texture, 0); }
+    };
+
+    Checksum expected = { 0 };
+    for (const Shape& shape : shapes)
+    {
+        expected.Add(shape.rect, shape.type == DrawCommandType::Image ? 0 : shape.color,
+                     shape.type == DrawCommandType::Gradient ? shape.color2 : 0);
+    }
+
+    CommandBuffer buffer;
+    CommandBuffer copy;
+    Checksum replayed = { 0 };
+    Uint64 recordTime = 0;
+    Uint64 hashTime = 0;
+    Uint64 copyTime = 0;
+    Uint64 replayTime = 0;
+
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        buffer.Clear();
+
+        for (const Shape& shape : shapes)
+        {
+            switch (shape.type)
+            {
+                case DrawCommandType::Fill: buffer.Fill(shape.rect, shape.color); break;
+                case DrawCommandType::Gradient: buffer.FillGradient(shape.rect, shape.color, shape.color2); break;
+                case DrawCommandType::Blend: buffer.Blend(shape.rect, shape.color); break;
+                case DrawCommandType::Image: buffer.DrawImage(shape.rect, 0); break;
+            }
+        }
+
+        Uint64 recorded = SDL_GetPerformanceCounter();
+        buffer.Hash();
+        Uint64 hashed = SDL_GetPerformanceCounter();
+
+        // What another process does with records it received
+        copy.Assign(buffer.Data(), buffer.Size());
+        Uint64 copied = SDL_GetPerformanceCounter();
+
+        replayed.sum = 0;
+        copy.Replay(replayed);
+        Uint64 end = SDL_GetPerformanceCounter();
+
+        recordTime += recorded - start;
+        hashTime += hashed - recorded;
+        copyTime += copied - hashed;
+        replayTime += end - copied;
+    }
+
+    double scale = 1000.0 / (double)SDL_GetPerformanceFrequency() / rounds;
+    SDL_Log("Command buffer of %u commands, %.1f KB, hash %016llx%s", buffer.Commands(), buffer.Size() / 1024.0,
+            (unsigned long long)buffer.Hash(), replayed.sum == expected.sum && copy.Hash() == buffer.Hash() ? "" : "  MISMATCH");
+    SDL_Log("record %.3f ms, hash %.3f ms, validate and copy %.3f ms, replay %.3f ms (%.1f ns per command)",
+            recordTime * scale, hashTime * scale, copyTime * scale, replayTime * scale, replayTime * scale * 1000000.0 / count);
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "Raster.h"
+
+class TileRenderer;
+
+
+// Draw commands recorded into one linear block of POD records, a 32-bit type followed by a payload
+// of fixed size per type. Records hold no pointers, so a buffer can be hashed to tell whether it
+// changed, replayed any number of times, saved to disk or copied into another process as is.
+#define COMMAND_BUFFER_MAGIC        0x42444D43  // "CMDB"
+#define COMMAND_BUFFER_VERSION      1
+#define COMMAND_HASH_SEED           0xCBF29CE484222325ull
+
+enum class DrawCommandType : uint32_t
+{
+    Fill = 1,
+    Gradient,
+    Blend,
+    Image
+};
+
+struct FillCommand
+{
+    RasterRect rect;
+    uint32_t color;
+};
+
+struct GradientCommand
+{
+    RasterRect rect;
+    uint32_t left;
+    uint32_t right;
+};
+
+struct BlendCommand
+{
+    RasterRect rect;
+    uint32_t color;
+};
+
+struct ImageCommand
+{
+    RasterRect rect;
+    uint32_t texture;   // index into the texture table given to Replay
+};
+
+// Prefixes a saved buffer
+struct CommandBufferHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t commands;
+    uint32_t size;      // bytes of records following the header
+    uint64_t hash;
+};
+
+// FNV-1a, chainable through seed
+uint64_t CommandHash(const void* data, size_t size, uint64_t seed = COMMAND_HASH_SEED);
+
+class CommandBuffer
+{
+public:
+    CommandBuffer() : commandCount(0), hash(0), hashValid(false) {}
+
+    void Clear();
+    void Fill(RasterRect rect, uint32_t color);
+    void FillGradient(RasterRect rect, uint32_t left, uint32_t right);
+    void Blend(RasterRect rect, uint32_t color);
+    void DrawImage(RasterRect rect, uint32_t texture);
+    void Append(const CommandBuffer& other);
+
+    uint32_t Commands() const { return commandCount; }
+    size_t Size() const { return data.size(); }
+    const uint8_t* Data() const { return data.data(); }
+
+    // Hash of the records, computed once per change
+    uint64_t Hash() const;
+
+    // Calls backend.Fill, FillGradient, Blend and DrawImage with the recorded arguments, in order
+    template <typename Backend>
+    void Replay(Backend& backend) const;
+
+    // Submits every command to renderer; DrawImage indices outside the texture table are skipped
+    void Replay(TileRenderer& renderer, const RasterImage* const* textures, uint32_t textureCount) const;
+
+    // Takes raw records, e.g. Data() of a buffer in another process; returns false when they are malformed
+    bool Assign(const void* records, size_t size);
+
+    bool Save(const char* path) const;
+    bool Load(const char* path);
+
+private:
+    template <typename Command>
+    void Record(DrawCommandType type, const Command& command);
+
+    static size_t PayloadSize(uint32_t type);
+
+    std::vector<uint8_t> data;
+    uint32_t commandCount;
+    mutable uint64_t hash;
+    mutable bool hashValid;
+};
+
+template <typename Backend>
+void CommandBuffer::Replay(Backend& backend) const
+{
+    // Records are validated when they come from outside, so the walk needs no checks
+    const uint8_t* record = data.data();
+    const uint8_t* end = record + data.size();
+
+    while (record < end)
+    {
+        uint32_t type = *(const uint32_t*)record;
+        const uint8_t* payload = record + sizeof(uint32_t);
+
+        switch ((DrawCommandType)type)
+        {
+            case DrawCommandType::Fill:
+            {
+                const FillCommand& command = *(const FillCommand*)payload;
+                backend.Fill(command.rect, command.color);
+                break;
+            }
+
+            case DrawCommandType::Gradient:
+            {
+                const GradientCommand& command = *(const GradientCommand*)payload;
+                backend.FillGradient(command.rect, command.left, command.right);
+                break;
+            }
+
+            case DrawCommandType::Blend:
+            {
+                const BlendCommand& command = *(const BlendCommand*)payload;
+                backend.Blend(command.rect, command.color);
+                break;
+            }
+
+            case DrawCommandType::Image:
+            {
+                const ImageCommand& command = *(const ImageCommand*)payload;
+                backend.DrawImage(command.rect, command.texture);
+                break;
+            }
+        }
+
+        record = payload + PayloadSize(type);
+    }
+}
+
+// Records a generated scene of count commands and logs the cost of recording, hashing, copying and replaying it
+void BenchmarkCommandBuffer(uint32_t count);
@@ -0,0 +1,1393 @@
+#include "Document.h"
+
+#include <psapi.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "CommandBuffer.h"
+#include "TileRenderer.h"
+
+// "0,0,0,0,00000000," is the shortest item line
+#define DOCUMENT_MIN_ITEM_BYTES     17
+
+#define DOCUMENT_PACK_MAGIC         0x4B415044      // "DPAK"
+#define DOCUMENT_PACK_VERSION       1
+#define DOCUMENT_PACK_ALIGN         4096            // sections start on a page
+
+struct DocumentPackSection
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+// At the start of a pack
+struct DocumentPackHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;
+    uint64_t sourceWriteTime;           // FILETIME of the last write to the source when it was compiled
+    uint64_t items;
+    RasterRect bounds;
+    DocumentPackSection blocks;         // DocumentBlock records, with item indices and label offsets
+    DocumentPackSection itemRecords;    // DocumentPackItem records, in block order
+    DocumentPackSection labels;         // the labels of each block back to back
+};
+
+struct DocumentPackItem
+{
+    RasterRect rect;
+    uint32_t color;
+    uint32_t labelEnd;      // from the start of the labels of its block
+};
+
+enum class DocumentLine
+{
+    Item,
+    Skipped,
+    Invalid
+};
+
+static bool ParseInteger(const char*& cursor, const char* end, int32_t& value)
+{
+    bool negative = cursor < end && *cursor == '-';
+    if (negative) cursor++;
+
+    int64_t result = 0;
+    const char* digits = cursor;
+    while (cursor < end && *cursor >= '0' && *cursor <= '9')
+    {
+        result = result * 10 + (*cursor++ - '0');
+        if (result > INT32_MAX) return false;
+    }
+
+    value = (int32_t)(negative ? -result : result);
+    return cursor > digits;
+}
+
+static bool ParseColor(const char*& cursor, const char* end, uint32_t& color)
+{
+    if (end - cursor < 8) return false;
+
+    color = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        char c = *cursor++;
+        uint32_t digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return false;
+        color = color << 4 | digit;
+    }
+    return true;
+}
+
+// Parses the line at cursor in place and moves cursor to the start of the next one
+static DocumentLine ParseLine(const char*& cursor, const char* end, DocumentItem& item)
+{
+    const char* line = cursor;
+    const char* newline = (const char*)memchr(line, '\n', (size_t)(end - line));
+    const char* stop = newline ? newline : end;
+    cursor = newline ? newline + 1 : end;
+
+    if (stop > line && stop[-1] == '\r') stop--;
+    if (line == stop || *line == '#') return DocumentLine::Skipped;
+
+    int32_t fields[4];
+    const char* field = line;
+    for (int32_t& value : fields)
+    {
+        if (!ParseInteger(field, stop, value) || field == stop || *field != ',') return DocumentLine::Invalid;
+        field++;
+    }
+
+    if (!ParseColor(field, stop, item.color) || field == stop || *field != ',') return DocumentLine::Invalid;
+    field++;
+
+    if (fields[2] < 0 || fields[3] < 0 || stop - field > UINT32_MAX) return DocumentLine::Invalid;
+
+    item.rect = { fields[0], fields[1], fields[2], fields[3] };
+    item.label = field;
+    item.labelLength = (uint32_t)(stop - field);
+    return DocumentLine::Item;
+}
+
+// A quick 64-bit hash to tell chunks apart, not one that resists crafted collisions
+static uint64_t HashBytes(const char* bytes, size_t length)
+{
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ length;
+    for (; length >= 8; bytes += 8, length -= 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        hash = (hash ^ word) * 0xBF58476D1CE4E5B9ull;
+        hash ^= hash >> 31;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, bytes, length);
+    hash = (hash ^ tail) * 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    return hash ^ hash >> 33;
+}
+
+// Hashes the line at cursor, newline included, and moves cursor to the start of the next one
+static uint64_t HashLine(const char*& cursor, const char* end)
+{
+    const char* line = cursor;
+    const char* newline = (const char*)memchr(line, '\n', (size_t)(end - line));
+    cursor = newline ? newline + 1 : end;
+    return HashBytes(line, (size_t)(cursor - line));
+}
+
+static bool ChunkBoundary(uint64_t lineHash)
+{
+    return (lineHash >> 40 & (DOCUMENT_CHUNK_LINES - 1)) == 0;
+}
+
+Document::Document()
+    : file(INVALID_HANDLE_VALUE), mapping(nullptr), data(nullptr), copied(false), size(0), indexed(0), lines(0), itemCount(0), reused(0), bounds({ 0, 0, 0, 0 }),
+      packItems(nullptr), packLabels(nullptr), packLabelBytes(0)
+{
+}
+
+Document::~Document()
+{
+    Close();
+}
+
+bool Document::Open(const wchar_t* path, DocumentProgress progress, void* context)
+{
+    if (!Map(path)) return false;
+
+    DocumentWindow window;
+    for (uint64_t begin = 0; begin < size; begin = window.end)
+    {
+        window.begin = begin;
+        window.end = WindowEnd(begin);
+        Scan(window);
+
+        // Before the window leaves the working set, so a sample here sees the most
+        if (progress) progress(context, window.end, size);
+        Trim(window);
+
+        if (!Append(window))
+        {
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+// The size and last write time of path, as a pack records them
+static bool SourceStamp(const wchar_t* path, uint64_t& size, uint64_t& writeTime)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &attributes)) return false;
+
+    size = (uint64_t)attributes.nFileSizeHigh << 32 | attributes.nFileSizeLow;
+    writeTime = (uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32 | attributes.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+bool Document::OpenPack(const wchar_t* source)
+{
+    Close();
+
+    uint64_t sourceSize, sourceWriteTime;
+    std::wstring pack = std::wstring(source) + DOCUMENT_PACK_EXTENSION;
+    if (!SourceStamp(source, sourceSize, sourceWriteTime) || GetFileAttributesW(pack.c_str()) == INVALID_FILE_ATTRIBUTES) return false;
+    if (!Map(pack.c_str())) return false;
+
+    DocumentPackHeader header = {};
+    if (size >= sizeof(DocumentPackHeader)) memcpy(&header, data, sizeof(DocumentPackHeader));
+
+    if (header.magic != DOCUMENT_PACK_MAGIC || header.version != DOCUMENT_PACK_VERSION || header.sourceSize != sourceSize ||
+        header.sourceWriteTime != sourceWriteTime)
+    {
+        SDL_Log("The pack of the document is out of date; parsing the document instead");
+        Close();
+        return false;
+    }
+
+    // Sections out of the file or of the wrong size mean a damaged pack; blocks are checked against
+    // the items here, labels against their block when read
+    auto fits = [&](const DocumentPackSection& section)
+    {
+        return section.offset % DOCUMENT_PACK_ALIGN == 0 && section.offset <= size && section.size <= size - section.offset;
+    };
+
+    bool valid = fits(header.blocks) && fits(header.itemRecords) && fits(header.labels) &&
+                 header.blocks.size % sizeof(DocumentBlock) == 0 && header.items <= header.itemRecords.size / sizeof(DocumentPackItem);
+
+    const DocumentBlock* packBlocks = (const DocumentBlock*)(data + header.blocks.offset);
+    size_t blockCount = valid ? (size_t)(header.blocks.size / sizeof(DocumentBlock)) : 0;
+
+    for (size_t i = 0; i < blockCount && valid; ++i)
+    {
+        valid = packBlocks[i].offset <= header.items && packBlocks[i].items <= header.items - packBlocks[i].offset &&
+                packBlocks[i].size <= header.labels.size;
+    }
+
+    if (!valid)
+    {
+        SDL_Log("The pack of the document is damaged; parsing the document instead");
+        Close();
+        return false;
+    }
+
+    blocks.assign(packBlocks, packBlocks + blockCount);
+    packItems = (const DocumentPackItem*)(data + header.itemRecords.offset);
+    packLabels = data + header.labels.offset;
+    packLabelBytes = header.labels.size;
+    itemCount = header.items;
+    bounds = header.bounds;
+    indexed = size;
+    return true;
+}
+
+bool Document::Map(const wchar_t* path)
+{
+    Close();
+
+    // Editors must be able to save over the open document, see Document.h
+    file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        SDL_Log("Unable to open the document (error %lu)", GetLastError());
+        return false;
+    }
+
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(file, &length))
+    {
+        SDL_Log("Unable to get the document size (error %lu)", GetLastError());
+        Close();
+        return false;
+    }
+
+    size = (uint64_t)length.QuadPart;
+    if (size > SIZE_MAX)
+    {
+        SDL_Log("A %.1f GB document does not fit the address space of this process", size / 1073741824.0);
+        Close();
+        return false;
+    }
+
+    // A small document is copied and its file closed at once, so editors can save over it any way they like
+    if (size <= DOCUMENT_COPY_BYTES)
+    {
+        char* copy = size > 0 ? (char*)VirtualAlloc(nullptr, (size_t)size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE) : nullptr;
+        uint64_t offset = 0;
+
+        while (copy != nullptr && offset < size)
+        {
+            DWORD count = (DWORD)SDL_min(size - offset, (uint64_t)DOCUMENT_COPY_BYTES);
+            DWORD done = 0;
+            if (!ReadFile(file, copy + offset, count, &done, nullptr) || done == 0) break;
+            offset += done;
+        }
+
+        if (offset < size)
+        {
+            SDL_Log("Unable to read the document (error %lu)", GetLastError());
+            if (copy) VirtualFree(copy, 0, MEM_RELEASE);
+            Close();
+            return false;
+        }
+
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        data = copy;
+        copied = true;
+    }
+    else
+    {
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        data = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+        if (data == nullptr)
+        {
+            SDL_Log("Unable to map the document (error %lu)", GetLastError());
+            Close();
+            return false;
+        }
+    }
+
+    // Every chunk ends at most one partly filled block early, so this many blocks never reallocate
+    uint64_t windows = (size + DOCUMENT_SCAN_WINDOW - 1) / DOCUMENT_SCAN_WINDOW;
+    uint64_t chunks = size / DOCUMENT_CHUNK_MIN_BYTES + windows;
+    blocks.reserve((size_t)(size / (DOCUMENT_MIN_ITEM_BYTES * DOCUMENT_BLOCK_ITEMS) + chunks + 1));
+    return true;
+}
+
+void Document::Swap(Document& other)
+{
+    std::swap(file, other.file);
+    std::swap(mapping, other.mapping);
+    std::swap(data, other.data);
+    std::swap(copied, other.copied);
+    std::swap(size, other.size);
+    std::swap(indexed, other.indexed);
+    std::swap(lines, other.lines);
+    std::swap(itemCount, other.itemCount);
+    std::swap(reused, other.reused);
+    std::swap(bounds, other.bounds);
+    blocks.swap(other.blocks);
+    chunks.swap(other.chunks);
+    chunkIndex.swap(other.chunkIndex);
+    std::swap(packItems, other.packItems);
+    std::swap(packLabels, other.packLabels);
+    std::swap(packLabelBytes, other.packLabelBytes);
+}
+
+uint64_t Document::WindowEnd(uint64_t begin) const
+{
+    if (size - begin <= DOCUMENT_SCAN_WINDOW) return size;
+
+    const char* end = data + size;
+    const char* limit = data + SDL_min(size, begin + 2 * (uint64_t)DOCUMENT_SCAN_WINDOW);
+    const char* cursor = data + begin + DOCUMENT_SCAN_WINDOW;
+
+    if (cursor[-1] != '\n')
+    {
+        const char* newline = (const char*)memchr(cursor, '\n', (size_t)(end - cursor));
+        cursor = newline ? newline + 1 : end;
+    }
+
+    // Windows placed by offset alone would split chunks differently in every version of the file
+    const char* line = cursor;
+    while (cursor < limit)
+    {
+        if (ChunkBoundary(HashLine(cursor, end))) return (uint64_t)(cursor - data);
+    }
+    return limit == end ? size : (uint64_t)(line - data);
+}
+
+void Document::Close()
+{
+    if (data && copied) VirtualFree((LPVOID)data, 0, MEM_RELEASE);
+    else if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+    file = INVALID_HANDLE_VALUE;
+    mapping = nullptr;
+    data = nullptr;
+    copied = false;
+    size = 0;
+    indexed = 0;
+    lines = 0;
+    itemCount = 0;
+    reused = 0;
+    bounds = { 0, 0, 0, 0 };
+    std::vector<DocumentBlock>().swap(blocks);
+    std::vector<DocumentChunk>().swap(chunks);
+    std::unordered_map<uint64_t, uint32_t>().swap(chunkIndex);
+    packItems = nullptr;
+    packLabels = nullptr;
+    packLabelBytes = 0;
+}
+
+void Document::Prefetch(const DocumentWindow& window) const
+{
+    // One read per page; the memory manager reads ahead in larger runs around each fault
+    volatile char sink = 0;
+    for (uint64_t offset = window.begin; offset < window.end; offset += 4096)
+    {
+        sink = data[offset];
+    }
+    (void)sink;
+}
+
+void Document::Scan(DocumentWindow& window, const Document* previous) const
+{
+    window.lines = 0;
+    window.invalidLine = 0;
+    window.items = 0;
+    window.reused = 0;
+    window.blocks.clear();
+    window.chunks.clear();
+
+    // Windows start on a line, the first one after the byte order mark if there is one
+    const char* cursor = data + window.begin;
+    const char* stop = data + window.end;
+    if (window.begin == 0 && size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) cursor += 3;
+
+    while (cursor < stop)
+    {
+        // With a previous version the lines up to the next boundary are hashed first, to know whether
+        // the chunk needs parsing at all; without one every chunk does, in the same pass
+        DocumentChunk chunk = {};
+        DocumentBlock block = {};
+        const char* start = cursor;
+        chunk.firstBlock = (uint32_t)window.blocks.size();
+        bool parse = previous == nullptr;
+        bool boundary = false;
+
+        while (cursor < stop && !boundary)
+        {
+            const char* line = cursor;
+            uint64_t lineHash = HashLine(cursor, stop);
+            chunk.hash = (chunk.hash ^ lineHash) * 0x9E3779B97F4A7C15ull;
+            chunk.lines++;
+            boundary = ChunkBoundary(lineHash) && cursor - start >= DOCUMENT_CHUNK_MIN_BYTES;
+
+            if (parse && !IndexLine(line, cursor, chunk.lines, window, chunk, block)) return;
+        }
+
+        chunk.offset = (uint64_t)(start - data);
+        chunk.size = (uint64_t)(cursor - start);
+
+        const DocumentChunk* same = parse ? nullptr : previous->FindChunk(chunk.hash, chunk.size);
+        if (same)
+        {
+            // The same bytes hold the same items, only further along the file
+            for (uint32_t i = 0; i < same->blockCount; ++i)
+            {
+                DocumentBlock moved = previous->blocks[same->firstBlock + i];
+                moved.offset = moved.offset - same->offset + chunk.offset;
+                window.blocks.push_back(moved);
+            }
+            chunk.items = same->items;
+            window.reused += chunk.size;
+        }
+        else if (!parse)
+        {
+            uint64_t line = 0;
+            for (const char* next = start; next < cursor;)
+            {
+                const char* lineStart = next;
+                const char* newline = (const char*)memchr(next, '\n', (size_t)(cursor - next));
+                next = newline ? newline + 1 : cursor;
+                if (!IndexLine(lineStart, next, ++line, window, chunk, block)) return;
+            }
+        }
+
+        if (block.items > 0) window.blocks.push_back(block);
+
+        chunk.blockCount = (uint32_t)window.blocks.size() - chunk.firstBlock;
+        window.lines += chunk.lines;
+        window.items += chunk.items;
+        window.chunks.push_back(chunk);
+    }
+}
+
+bool Document::IndexLine(const char* line, const char* next, uint64_t lineInChunk, DocumentWindow& window, DocumentChunk& chunk,
+                         DocumentBlock& block) const
+{
+    DocumentItem item;
+    const char* cursor = line;
+    DocumentLine kind = ParseLine(cursor, next, item);
+
+    if (kind == DocumentLine::Invalid)
+    {
+        window.invalidLine = window.lines + lineInChunk;
+        return false;
+    }
+
+    if (kind == DocumentLine::Item)
+    {
+        if (block.items == 0) block.offset = (uint64_t)(line - data);
+        block.size = (uint64_t)(next - data) - block.offset;
+        block.bounds = RasterUnion(block.bounds, item.rect);
+        chunk.items++;
+
+        if (++block.items == DOCUMENT_BLOCK_ITEMS)
+        {
+            window.blocks.push_back(block);
+            block = {};
+        }
+    }
+    return true;
+}
+
+bool Document::Append(DocumentWindow& window)
+{
+    if (window.invalidLine > 0)
+    {
+        SDL_Log("Line %llu of the document is not x,y,width,height,color,label", (unsigned long long)(lines + window.invalidLine));
+        return false;
+    }
+
+    for (DocumentChunk& chunk : window.chunks)
+    {
+        chunk.firstBlock += (uint32_t)blocks.size();
+        chunkIndex.emplace(chunk.hash, (uint32_t)chunks.size());
+        chunks.push_back(chunk);
+    }
+
+    for (const DocumentBlock& block : window.blocks)
+    {
+        bounds = RasterUnion(bounds, block.bounds);
+        blocks.push_back(block);
+    }
+
+    indexed = window.end;
+    lines += window.lines;
+    itemCount += window.items;
+    reused += window.reused;
+    std::vector<DocumentBlock>().swap(window.blocks);
+    std::vector<DocumentChunk>().swap(window.chunks);
+    return true;
+}
+
+void Document::Trim(const DocumentWindow& window) const
+{
+    // Unlocking pages that are not locked drops them from the working set; they stay in the system cache.
+    // A copy would go to the page file instead, and is small enough to keep.
+    if (window.end > window.begin && !copied) VirtualUnlock((LPVOID)(data + window.begin), (SIZE_T)(window.end - window.begin));
+}
+
+void Document::Read(const DocumentBlock& block, std::vector<DocumentItem>& items) const
+{
+    items.clear();
+
+    if (packItems)
+    {
+        // Labels past the end of the section would come from a damaged pack
+        const DocumentPackItem* record = packItems + block.offset;
+        const char* labels = packLabels + block.size;
+        uint64_t available = packLabelBytes - block.size;
+        uint32_t start = 0;
+
+        items.resize(block.items);
+        for (DocumentItem& item : items)
+        {
+            uint32_t end = (uint32_t)SDL_min((uint64_t)record->labelEnd, available);
+            start = SDL_min(start, end);
+            item = { record->rect, record->color, labels + start, end - start };
+            start = end;
+            record++;
+        }
+        return;
+    }
+
+    const char* cursor = data + block.offset;
+    const char* end = cursor + block.size;
+    DocumentItem item;
+
+    while (cursor < end)
+    {
+        if (ParseLine(cursor, end, item) == DocumentLine::Item) items.push_back(item);
+    }
+}
+
+const DocumentChunk* Document::FindChunk(uint64_t hash, uint64_t bytes) const
+{
+    auto found = chunkIndex.find(hash);
+    if (found == chunkIndex.end() || chunks[found->second].size != bytes) return nullptr;
+    return &chunks[found->second];
+}
+
+DocumentLoader::DocumentLoader()
+    : document(nullptr), previous(nullptr), wake(nullptr), inFlight(0), windowCount(0), prefetched(0), committed(0), stopping(false)
+{
+    mutex = SDL_CreateMutex();
+    changed = SDL_CreateCond();
+}
+
+DocumentLoader::~DocumentLoader()
+{
+    Cancel();
+    SDL_DestroyCond(changed);
+    SDL_DestroyMutex(mutex);
+}
+
+bool DocumentLoader::Start(Document* target, const wchar_t* path, uint32_t workers, HANDLE wakeEvent, const Document* earlier)
+{
+    Cancel();
+    return target->Map(path) && Start(target, workers, wakeEvent, earlier);
+}
+
+bool DocumentLoader::Start(Document* target, uint32_t workers, HANDLE wakeEvent, const Document* earlier)
+{
+    Cancel();
+
+    document = target;
+    previous = earlier;
+    wake = wakeEvent;
+
+    // Every window but the last holds DOCUMENT_SCAN_WINDOW bytes or more
+    uint64_t size = document->Size();
+    windows.resize((size_t)((size + DOCUMENT_SCAN_WINDOW - 1) / DOCUMENT_SCAN_WINDOW));
+    windowCount = (uint32_t)windows.size();
+
+    scanned.assign(windows.size(), 0);
+    ready.clear();
+    prefetched = 0;
+    committed = 0;
+    stopping = false;
+
+    if (workers == 0) workers = (uint32_t)SDL_max(1, SDL_GetCPUCount() - 2);
+    workers = SDL_min(workers, (uint32_t)windows.size());
+    inFlight = workers + 2;
+
+    // Nothing to scan in an empty file; Commit finishes at once
+    if (workers == 0) return true;
+
+    threads.push_back(SDL_CreateThread(PrefetchMain, "DocumentPrefetch", this));
+    for (uint32_t i = 0; i < workers; ++i)
+    {
+        threads.push_back(SDL_CreateThread(WorkerMain, "DocumentWorker", this));
+    }
+
+    for (SDL_Thread* thread : threads)
+    {
+        if (thread == nullptr)
+        {
+            SDL_Log("Unable to start a document thread: %s", SDL_GetError());
+            Cancel();
+            return false;
+        }
+    }
+    return true;
+}
+
+DocumentLoad DocumentLoader::Commit()
+{
+    if (document == nullptr) return DocumentLoad::Idle;
+
+    for (;;)
+    {
+        SDL_LockMutex(mutex);
+        uint32_t next = committed;
+        bool available = next < windowCount && scanned[next];
+        SDL_UnlockMutex(mutex);
+
+        if (!available) break;
+
+        // Workers are done with a window once it is marked scanned
+        bool valid = document->Append(windows[next]);
+
+        SDL_LockMutex(mutex);
+        committed++;
+        SDL_CondBroadcast(changed);
+        SDL_UnlockMutex(mutex);
+
+        if (!valid)
+        {
+            Cancel();
+            return DocumentLoad::Failed;
+        }
+    }
+
+    SDL_LockMutex(mutex);
+    bool loading = committed < windowCount;
+    SDL_UnlockMutex(mutex);
+
+    if (loading) return DocumentLoad::Loading;
+
+    Cancel();
+    return DocumentLoad::Done;
+}
+
+void DocumentLoader::Cancel()
+{
+    SDL_LockMutex(mutex);
+    stopping = true;
+    SDL_CondBroadcast(changed);
+    SDL_UnlockMutex(mutex);
+
+    for (SDL_Thread* thread : threads)
+    {
+        if (thread) SDL_WaitThread(thread, nullptr);
+    }
+
+    threads.clear();
+    windows.clear();
+    scanned.clear();
+    ready.clear();
+    document = nullptr;
+    previous = nullptr;
+}
+
+int DocumentLoader::PrefetchMain(void* data)
+{
+    DocumentLoader& loader = *(DocumentLoader*)data;
+
+    uint64_t begin = 0;
+    for (uint32_t index = 0; index < loader.windows.size(); ++index)
+    {
+        SDL_LockMutex(loader.mutex);
+        while (!loader.stopping && index - loader.committed >= loader.inFlight)
+        {
+            SDL_CondWait(loader.changed, loader.mutex);
+        }
+
+        bool stopping = loader.stopping;
+        SDL_UnlockMutex(loader.mutex);
+        if (stopping) break;
+
+        // Workers only see a window once it is ready
+        DocumentWindow& window = loader.windows[index];
+        window.begin = begin;
+        window.end = loader.document->WindowEnd(begin);
+        loader.document->Prefetch(window);
+        begin = window.end;
+
+        SDL_LockMutex(loader.mutex);
+        loader.ready.push_back(index);
+        loader.prefetched++;
+        if (begin == loader.document->Size()) loader.windowCount = index + 1;
+        SDL_CondBroadcast(loader.changed);
+        SDL_UnlockMutex(loader.mutex);
+
+        if (begin == loader.document->Size()) break;
+    }
+    return 0;
+}
+
+int DocumentLoader::WorkerMain(void* data)
+{
+    DocumentLoader& loader = *(DocumentLoader*)data;
+
+    for (;;)
+    {
+        SDL_LockMutex(loader.mutex);
+        while (!loader.stopping && loader.ready.empty() && loader.prefetched < loader.windowCount)
+        {
+            SDL_CondWait(loader.changed, loader.mutex);
+        }
+
+        if (loader.stopping || loader.ready.empty())
+        {
+            SDL_UnlockMutex(loader.mutex);
+            return 0;
+        }
+
+        uint32_t index = loader.ready.front();
+        loader.ready.pop_front();
+        SDL_UnlockMutex(loader.mutex);
+
+        loader.document->Scan(loader.windows[index], loader.previous);
+        loader.document->Trim(loader.windows[index]);
+
+        SDL_LockMutex(loader.mutex);
+        loader.scanned[index] = 1;
+        SDL_UnlockMutex(loader.mutex);
+
+        SetEvent(loader.wake);
+    }
+}
+
+static uint64_t PackAlign(uint64_t offset)
+{
+    return (offset + DOCUMENT_PACK_ALIGN - 1) / DOCUMENT_PACK_ALIGN * DOCUMENT_PACK_ALIGN;
+}
+
+// Writes bytes at offset in a file opened for synchronous writes
+static bool WriteAt(HANDLE file, uint64_t offset, const void* bytes, size_t count)
+{
+    for (size_t written = 0; written < count;)
+    {
+        OVERLAPPED position = {};
+        position.Offset = (DWORD)(offset + written);
+        position.OffsetHigh = (DWORD)((offset + written) >> 32);
+
+        DWORD part = (DWORD)SDL_min(count - written, (size_t)1 << 30);
+        DWORD done = 0;
+        if (!WriteFile(file, (const char*)bytes + written, part, &done, &position) || done != part) return false;
+        written += done;
+    }
+    return true;
+}
+
+bool CompileDocument(const wchar_t* source, const wchar_t* pack)
+{
+    // Stamped before the source is mapped, so one replaced in between leaves the pack out of date rather than wrong
+    uint64_t sourceSize, sourceWriteTime;
+    if (!SourceStamp(source, sourceSize, sourceWriteTime))
+    {
+        SDL_Log("Unable to find the document (error %lu)", GetLastError());
+        return false;
+    }
+
+    Document document;
+    if (!document.Open(source)) return false;
+
+    // Every section but the labels has a known size, so items and labels stream to their places in one pass
+    DocumentPackHeader header = {};
+    header.magic = DOCUMENT_PACK_MAGIC;
+    header.version = DOCUMENT_PACK_VERSION;
+    header.sourceSize = sourceSize;
+    header.sourceWriteTime = sourceWriteTime;
+    header.items = document.Items();
+    header.bounds = document.Bounds();
+    header.blocks = { PackAlign(sizeof(DocumentPackHeader)), document.Blocks().size() * sizeof(DocumentBlock) };
+    header.itemRecords = { PackAlign(header.blocks.offset + header.blocks.size), header.items * sizeof(DocumentPackItem) };
+    header.labels = { PackAlign(header.itemRecords.offset + header.itemRecords.size), 0 };
+
+    std::wstring temporary = std::wstring(pack) + L"." + std::to_wstring(GetCurrentProcessId());
+    HANDLE file = CreateFileW(temporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        SDL_Log("Unable to write the pack (error %lu)", GetLastError());
+        return false;
+    }
+
+    const size_t flushBytes = 4 << 20;
+    std::vector<DocumentBlock> blocks;
+    std::vector<DocumentPackItem> records;
+    std::vector<DocumentItem> items;
+    std::string labels;
+    blocks.reserve(document.Blocks().size());
+
+    uint64_t firstItem = 0;
+    uint64_t itemsWritten = 0;
+    uint64_t labelsWritten = 0;
+    bool ok = true;
+
+    for (const DocumentBlock& block : document.Blocks())
+    {
+        document.Read(block, items);
+
+        DocumentBlock packed = {};
+        packed.offset = firstItem;
+        packed.size = header.labels.size;
+        packed.items = (uint32_t)items.size();
+        packed.bounds = block.bounds;
+
+        uint64_t labelEnd = 0;
+        for (const DocumentItem& item : items)
+        {
+            labelEnd += item.labelLength;
+            records.push_back({ item.rect, item.color, (uint32_t)labelEnd });
+            labels.append(item.label, item.labelLength);
+        }
+
+        if (labelEnd > UINT32_MAX)
+        {
+            SDL_Log("The labels of a block do not fit a pack");
+            ok = false;
+            break;
+        }
+
+        blocks.push_back(packed);
+        firstItem += items.size();
+        header.labels.size += labelEnd;
+
+        if (records.size() * sizeof(DocumentPackItem) + labels.size() >= flushBytes || &block == &document.Blocks().back())
+        {
+            ok = WriteAt(file, header.itemRecords.offset + itemsWritten * sizeof(DocumentPackItem), records.data(),
+                         records.size() * sizeof(DocumentPackItem)) &&
+                 WriteAt(file, header.labels.offset + labelsWritten, labels.data(), labels.size());
+            itemsWritten += records.size();
+            labelsWritten += labels.size();
+            records.clear();
+            labels.clear();
+            if (!ok) break;
+        }
+    }
+
+    // Without labels, or without any block, nothing was written up to the labels; the file still ends past them
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)(header.labels.offset + header.labels.size);
+
+    ok = ok && WriteAt(file, header.blocks.offset, blocks.data(), blocks.size() * sizeof(DocumentBlock)) &&
+         WriteAt(file, 0, &header, sizeof(DocumentPackHeader)) && SetFilePointerEx(file, end, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+    CloseHandle(file);
+
+    if (!ok)
+    {
+        SDL_Log("Unable to write the pack (error %lu)", GetLastError());
+        DeleteFileW(temporary.c_str());
+        return false;
+    }
+
+    if (!MoveFileExW(temporary.c_str(), pack, MOVEFILE_REPLACE_EXISTING))
+    {
+        // A child showing the document keeps its pack mapped, and Windows does not replace a mapped file
+        DWORD error = GetLastError();
+        if (error == ERROR_ACCESS_DENIED || error == ERROR_SHARING_VIOLATION || error == ERROR_USER_MAPPED_FILE)
+        {
+            SDL_Log("The pack is in use, probably by a child showing the document; close it there and compile again");
+        }
+        else
+        {
+            SDL_Log("Unable to replace the pack (error %lu)", error);
+        }
+
+        DeleteFileW(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+uint32_t RecordDocumentPreview(const Document& document, uint32_t blocks, RasterRect view, CommandBuffer& commands,
+                               std::vector<DocumentItem>& items)
+{
+    uint32_t recorded = 0;
+
+    for (uint32_t i = 0; i < blocks && recorded < DOCUMENT_PREVIEW_ITEMS; ++i)
+    {
+        const DocumentBlock& block = document.Blocks()[i];
+        if (RasterEmpty(RasterIntersect(block.bounds, view))) continue;
+
+        document.Read(block, items);
+        for (const DocumentItem& item : items)
+        {
+            if (RasterEmpty(RasterIntersect(item.rect, view))) continue;
+
+            commands.Blend(item.rect, item.color);
+            if (++recorded == DOCUMENT_PREVIEW_ITEMS) break;
+        }
+    }
+    return recorded;
+}
+
+static size_t WorkingSet()
+{
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+}
+
+static void SampleWorkingSet(void* context, uint64_t, uint64_t)
+{
+    size_t& peak = *(size_t*)context;
+    peak = SDL_max(peak, WorkingSet());
+}
+
+// Writes about size bytes of items on a grid, stopping at the last whole line. Eight evenly spaced
+// edits covering a share edited of the file relabel the items in them, which moves every line after.
+// In place, the existing file is overwritten through a handle sharing it with a mapping, the way an
+// editor saves without replacing the file, and a shorter version is padded with empty lines since a
+// mapped file cannot be truncated.
+static bool GenerateDocument(const wchar_t* path, uint64_t size, double edited = 0.0, bool inPlace = false)
+{
+    HANDLE file = inPlace ? CreateFileW(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                        FILE_ATTRIBUTE_NORMAL, nullptr)
+                          : CreateFileW(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER previousLength = {};
+    if (inPlace && !GetFileSizeEx(file, &previousLength))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    const size_t chunk = 1 << 20;
+    std::string buffer;
+    buffer.reserve(chunk + 128);
+
+    uint32_t seed = 12345;
+    uint32_t index = 0;
+    uint64_t written = 0;
+    bool ok = true;
+
+    while (ok && written < size)
+    {
+        buffer.clear();
+        while (buffer.size() < chunk)
+        {
+            seed = seed * 1664525 + 1013904223;
+            uint64_t offset = written + buffer.size();
+            uint64_t edit = (uint64_t)(edited * size / 8);
+            bool relabel = edit > 0 && (offset + edit / 2) % (size / 8) < edit;
+
+            char line[96];
+            int length = SDL_snprintf(line, sizeof(line), "%d,%d,%d,%d,ff%06x,%s %u\n", (int)(index % 4096) * 24, (int)(index / 4096) * 24,
+                                      12 + (int)(seed >> 28), 12 + (int)(seed >> 24 & 0xF), seed >> 8 & 0xFFFFFF, relabel ? "Edited" : "Item", index);
+            buffer.append(line, length);
+            index++;
+        }
+
+        size_t count = buffer.size();
+        if (written + count > size)
+        {
+            count = buffer.rfind('\n', (size_t)(size - written) - 1) + 1;
+            if (count == 0) break;
+        }
+
+        DWORD done = 0;
+        ok = WriteFile(file, buffer.data(), (DWORD)count, &done, nullptr) && done == count;
+        written += count;
+    }
+
+    while (ok && written < (uint64_t)previousLength.QuadPart)
+    {
+        DWORD count = (DWORD)SDL_min((uint64_t)previousLength.QuadPart - written, (uint64_t)chunk);
+        buffer.assign(count, '\n');
+
+        DWORD done = 0;
+        ok = WriteFile(file, buffer.data(), count, &done, nullptr) && done == count;
+        written += count;
+    }
+
+    CloseHandle(file);
+    return ok;
+}
+
+void BenchmarkDocument(uint32_t megabytes)
+{
+    uint32_t sizes[3] = { megabytes, 0, 0 };
+    if (megabytes == 0)
+    {
+        sizes[0] = 100;
+        sizes[1] = 1024;
+        sizes[2] = 8192;
+    }
+
+    wchar_t directory[MAX_PATH];
+    if (GetTempPathW(MAX_PATH, directory) == 0)
+    {
+        SDL_Log("No temporary directory for the documents (error %lu)", GetLastError());
+        return;
+    }
+
+    for (uint32_t megabyte : sizes)
+    {
+        if (megabyte == 0) continue;
+
+        std::wstring path = std::wstring(directory) + L"ChildDocument" + std::to_wstring(megabyte) + L".txt";
+        Uint64 frequency = SDL_GetPerformanceFrequency();
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        if (!GenerateDocument(path.c_str(), (uint64_t)megabyte << 20))
+        {
+            SDL_Log("Unable to write a %u MB document (error %lu)", megabyte, GetLastError());
+            DeleteFileW(path.c_str());
+            continue;
+        }
+
+        SDL_Log("Generated a %u MB document in %.1f s", megabyte, (double)(SDL_GetPerformanceCounter() - start) / frequency);
+
+        // Both passes find the file in the system cache after generating it, so they differ in copying and memory, not disk time
+        size_t before = WorkingSet();
+        size_t peak = before;
+        Document document;
+
+        start = SDL_GetPerformanceCounter();
+        bool opened = document.Open(path.c_str(), SampleWorkingSet, &peak);
+        double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+
+        if (opened)
+        {
+            SDL_Log("  mapped: %8.0f ms, %5.2f GB/s, peak working set %7.1f MB, %llu items in %u blocks", ms,
+                    document.Size() / 1073741824.0 / (ms / 1000.0), peak / 1048576.0,
+                    (unsigned long long)document.Items(), (unsigned)document.Blocks().size());
+        }
+        document.Close();
+
+        // A private copy of the whole file, before any parsing
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER length = {};
+        GetFileSizeEx(file, &length);
+        char* copy = (uint64_t)length.QuadPart <= SIZE_MAX ?
+                     (char*)VirtualAlloc(nullptr, (size_t)length.QuadPart, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE) : nullptr;
+
+        if (copy)
+        {
+            start = SDL_GetPerformanceCounter();
+            uint64_t offset = 0;
+            DWORD done = 1;
+
+            while (offset < (uint64_t)length.QuadPart && done > 0)
+            {
+                DWORD count = (DWORD)SDL_min((uint64_t)length.QuadPart - offset, (uint64_t)1 << 30);
+                if (!ReadFile(file, copy + offset, count, &done, nullptr)) break;
+                offset += done;
+            }
+
+            ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+            SDL_Log("  read:   %8.0f ms, %5.2f GB/s, peak working set %7.1f MB, without parsing", ms,
+                    offset / 1073741824.0 / (ms / 1000.0), SDL_max(before, WorkingSet()) / 1048576.0);
+            VirtualFree(copy, 0, MEM_RELEASE);
+        }
+        else
+        {
+            SDL_Log("  read:   not enough memory to read it whole");
+        }
+
+        CloseHandle(file);
+        DeleteFileW(path.c_str());
+    }
+}
+
+static double Percentile(std::vector<double>& values, uint32_t percent)
+{
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    return values[SDL_min(values.size() - 1, values.size() * percent / 100)];
+}
+
+void BenchmarkDocumentLoader(uint32_t megabytes)
+{
+    const int32_t width = 1280;
+    const int32_t height = 720;
+    const double frameMs = 1000.0 / 60.0;
+
+    if (megabytes == 0) megabytes = 1024;
+
+    wchar_t directory[MAX_PATH];
+    if (GetTempPathW(MAX_PATH, directory) == 0)
+    {
+        SDL_Log("No temporary directory for the document (error %lu)", GetLastError());
+        return;
+    }
+
+    std::wstring path = std::wstring(directory) + L"ChildDocumentLoad" + std::to_wstring(megabytes) + L".txt";
+    if (!GenerateDocument(path.c_str(), (uint64_t)megabytes << 20))
+    {
+        SDL_Log("Unable to write a %u MB document (error %lu)", megabytes, GetLastError());
+        DeleteFileW(path.c_str());
+        return;
+    }
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Document document;
+
+    // Opening on the frame loop stalls it for the whole scan
+    Uint64 start = SDL_GetPerformanceCounter();
+    bool opened = document.Open(path.c_str());
+    double blockingMs = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+    document.Close();
+
+    if (!opened)
+    {
+        DeleteFileW(path.c_str());
+        return;
+    }
+
+    std::vector<uint32_t> pixels((size_t)width * height);
+    RasterImage target = { pixels.data(), width, height, width };
+    TileRenderer renderer(1);
+    CommandBuffer commands;
+    std::vector<DocumentItem> items;
+    std::vector<double> frameTimes;
+    std::vector<double> gaps;
+
+    HANDLE wake = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    DocumentLoader loader;
+    start = SDL_GetPerformanceCounter();
+
+    if (!loader.Start(&document, path.c_str(), 0, wake))
+    {
+        CloseHandle(wake);
+        DeleteFileW(path.c_str());
+        return;
+    }
+
+    // Commit and draw the preview every frame like the update and render threads, on one thread here
+    DocumentLoad load = DocumentLoad::Loading;
+    Uint64 previous = start;
+    uint32_t previewBlocks = UINT32_MAX;
+
+    while (load == DocumentLoad::Loading)
+    {
+        Uint64 frameStart = SDL_GetPerformanceCounter();
+        load = loader.Commit();
+
+        uint32_t blocks = (uint32_t)document.Blocks().size();
+        if (blocks != previewBlocks)
+        {
+            commands.Clear();
+            commands.Fill({ 0, 0, width, height }, 0xFF203040);
+            RecordDocumentPreview(document, blocks, { 0, 0, width, height }, commands, items);
+
+            int32_t bar = (int32_t)(width * (double)document.Indexed() / (double)SDL_max(1ull, document.Size()));
+            commands.Fill({ 0, 0, bar, 4 }, 0xFFE0E0E0);
+            previewBlocks = blocks;
+        }
+
+        commands.Replay(renderer, nullptr, 0);
+        renderer.Render(target);
+
+        Uint64 end = SDL_GetPerformanceCounter();
+        frameTimes.push_back((double)(end - frameStart) * 1000.0 / frequency);
+        gaps.push_back((double)(frameStart - previous) * 1000.0 / frequency);
+        previous = frameStart;
+
+        double elapsed = (double)(end - frameStart) * 1000.0 / frequency;
+        if (elapsed < frameMs) SDL_Delay((Uint32)(frameMs - elapsed));
+    }
+
+    double loadMs = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+
+    SDL_Log("%u MB document, %llu items", megabytes, (unsigned long long)document.Items());
+    SDL_Log("  open on the frame loop: one frame of %.0f ms", blockingMs);
+    SDL_Log("  background load: %.0f ms over %u frames, frame time p50 %.2f ms, p99 %.2f ms, max %.2f ms, longest gap %.2f ms",
+            loadMs, (unsigned)frameTimes.size(), Percentile(frameTimes, 50), Percentile(frameTimes, 99),
+            Percentile(frameTimes, 100), Percentile(gaps, 100));
+
+    if (load == DocumentLoad::Failed) SDL_Log("  the background load failed");
+
+    document.Close();
+    CloseHandle(wake);
+    DeleteFileW(path.c_str());
+}
+
+void BenchmarkDocumentReload(uint32_t megabytes)
+{
+    const double shares[] = { 0.0, 0.0001, 0.001, 0.01, 0.1, 0.5, 1.0 };
+
+    if (megabytes == 0) megabytes = 1024;
+
+    wchar_t directory[MAX_PATH];
+    if (GetTempPathW(MAX_PATH, directory) == 0)
+    {
+        SDL_Log("No temporary directory for the document (error %lu)", GetLastError());
+        return;
+    }
+
+    // Windows refuses to rename over a mapped file, so each version is saved in place over the first one,
+    // which stays open and mapped as the previous version
+    std::wstring original = std::wstring(directory) + L"ChildDocumentReload" + std::to_wstring(megabytes) + L".txt";
+    uint64_t size = (uint64_t)megabytes << 20;
+
+    if (!GenerateDocument(original.c_str(), size))
+    {
+        SDL_Log("Unable to write a %u MB document (error %lu)", megabytes, GetLastError());
+        DeleteFileW(original.c_str());
+        return;
+    }
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    HANDLE wake = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    DocumentLoader loader;
+    Document document;
+    Document reloaded;
+    Document full;
+
+    // Loads path into target like the update thread does, waiting on wake between commits
+    auto load = [&](Document& target, const std::wstring& path, const Document* previous) -> double
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (!loader.Start(&target, path.c_str(), 0, wake, previous)) return -1.0;
+
+        DocumentLoad state;
+        while ((state = loader.Commit()) == DocumentLoad::Loading) WaitForSingleObject(wake, INFINITE);
+        return state == DocumentLoad::Done ? (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / frequency : -1.0;
+    };
+
+    double fullMs = load(document, original, nullptr);
+    if (fullMs < 0.0)
+    {
+        SDL_Log("Unable to load the %u MB document", megabytes);
+        CloseHandle(wake);
+        DeleteFileW(original.c_str());
+        return;
+    }
+
+    SDL_Log("%u MB document, %llu items: full load %.0f ms", megabytes, (unsigned long long)document.Items(), fullMs);
+
+    for (double share : shares)
+    {
+        if (!GenerateDocument(original.c_str(), size, share, true))
+        {
+            SDL_Log("Unable to save over the open document (error %lu)", GetLastError());
+            break;
+        }
+
+        double reloadMs = load(reloaded, original, &document);
+        double fullEditedMs = load(full, original, nullptr);
+
+        // Reusing chunks must give the index a full load would
+        bool same = reloadMs >= 0.0 && fullEditedMs >= 0.0 &&
+                    std::equal(reloaded.Blocks().begin(), reloaded.Blocks().end(), full.Blocks().begin(), full.Blocks().end(),
+                               [](const DocumentBlock& a, const DocumentBlock& b)
+                               {
+                                   return a.offset == b.offset && a.size == b.size && a.items == b.items &&
+                                          memcmp(&a.bounds, &b.bounds, sizeof(RasterRect)) == 0;
+                               });
+
+        SDL_Log("  %6.2f%% edited: reload %6.0f ms, %6.2f%% reused, full load %6.0f ms%s", share * 100.0, reloadMs,
+                reloaded.Reused() * 100.0 / (double)SDL_max(1ull, reloaded.Size()), fullEditedMs, same ? "" : ", INDEX DIFFERS");
+
+        reloaded.Close();
+        full.Close();
+    }
+
+    document.Close();
+    CloseHandle(wake);
+    DeleteFileW(original.c_str());
+}
+
+void BenchmarkDocumentPack(uint32_t megabytes)
+{
+    const int32_t width = 1280;
+    const int32_t height = 720;
+
+    if (megabytes == 0) megabytes = 1024;
+
+    wchar_t directory[MAX_PATH];
+    if (GetTempPathW(MAX_PATH, directory) == 0)
+    {
+        SDL_Log("No temporary directory for the document (error %lu)", GetLastError());
+        return;
+    }
+
+    std::wstring path = std::wstring(directory) + L"ChildDocumentPack" + std::to_wstring(megabytes) + L".txt";
+    std::wstring pack = path + DOCUMENT_PACK_EXTENSION;
+    if (!GenerateDocument(path.c_str(), (uint64_t)megabytes << 20))
+    {
+        SDL_Log("Unable to write a %u MB document (error %lu)", megabytes, GetLastError());
+        DeleteFileW(path.c_str());
+        return;
+    }
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 start = SDL_GetPerformanceCounter();
+    bool compiled = CompileDocument(path.c_str(), pack.c_str());
+    double compileMs = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+
+    if (!compiled)
+    {
+        DeleteFileW(path.c_str());
+        return;
+    }
+
+    WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+    GetFileAttributesExW(pack.c_str(), GetFileExInfoStandard, &attributes);
+    uint64_t packSize = (uint64_t)attributes.nFileSizeHigh << 32 | attributes.nFileSizeLow;
+    SDL_Log("%u MB document compiled in %.0f ms into a %.0f MB pack", megabytes, compileMs, packSize / 1048576.0);
+
+    std::vector<uint32_t> pixels((size_t)width * height);
+    RasterImage target = { pixels.data(), width, height, width };
+    TileRenderer renderer(1);
+    CommandBuffer commands;
+    std::vector<DocumentItem> items;
+    std::vector<uint32_t> sourceFrame;
+
+    // Both find their files in the system cache, so this is the parsing a pack saves, not disk time
+    for (int packed = 0; packed < 2; ++packed)
+    {
+        Document document;
+        start = SDL_GetPerformanceCounter();
+        bool opened = packed ? document.OpenPack(path.c_str()) : document.Open(path.c_str());
+        Uint64 openEnd = SDL_GetPerformanceCounter();
+
+        if (!opened)
+        {
+            SDL_Log("  unable to open the %s", packed ? "pack" : "document");
+            continue;
+        }
+
+        commands.Clear();
+        commands.Fill({ 0, 0, width, height }, 0xFF203040);
+        uint32_t recorded = RecordDocumentPreview(document, (uint32_t)document.Blocks().size(), { 0, 0, width, height }, commands, items);
+        commands.Replay(renderer, nullptr, 0);
+        renderer.Render(target);
+        Uint64 frameEnd = SDL_GetPerformanceCounter();
+
+        // The pack must draw what the source does
+        bool same = true;
+        if (packed) same = sourceFrame == pixels;
+        else sourceFrame = pixels;
+
+        SDL_Log("  %s: open %8.1f ms, first frame %6.1f ms, open to first frame %8.1f ms, %llu items, %u drawn%s",
+                packed ? "pack  " : "source", (double)(openEnd - start) * 1000.0 / frequency, (double)(frameEnd - openEnd) * 1000.0 / frequency,
+                (double)(frameEnd - start) * 1000.0 / frequency, (unsigned long long)document.Items(), recorded, same ? "" : ", FRAME DIFFERS");
+    }
+
+    DeleteFileW(pack.c_str());
+    DeleteFileW(path.c_str());
+}
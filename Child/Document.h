@@ -0,0 +1,255 @@
+#pragma once
+
+#include <windows.h>
+
+#include <deque>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <SDL.h>
+
+#include "Raster.h"
+
+class CommandBuffer;
+
+
+// A document is UTF-8 text with one item per line,
+//     x,y,width,height,color,label
+// in bottom-up pixels, color as premultiplied AARRGGBB hex and label the rest of the line; empty lines
+// and lines starting with # are skipped. A large file is mapped read-only and never copied: opening scans
+// it once to validate every line and index blocks of items by their offset and bounds, and items are
+// parsed again from the mapping when a block is read, their labels pointing into it. The file is
+// scanned in windows, each holding the lines that start inside it, and every window is dropped from
+// the working set once its blocks are indexed, so opening needs little more memory than the index
+// whatever the size of the file.
+//
+// Lines are grouped into chunks that end after a line whose hash matches DOCUMENT_CHUNK_LINES, so the
+// boundaries follow the content rather than offsets and an edit only changes the chunks it touches.
+// Windows end on a chunk boundary and blocks never span one; reloading a document hashes every chunk
+// and takes the blocks of those already indexed in the previous version, parsing only the rest.
+//
+// Saving over an open document: one up to DOCUMENT_COPY_BYTES is read into memory and its file closed
+// at once, so editors save it any way they like. A larger one stays mapped, sharing reads, writes and
+// deletion, but Windows neither deletes, renames over nor truncates a file with a mapped view: saves
+// that write a new file and rename it over the document, delete and recreate it, or rewrite it shorter
+// fail in the editor while it is open. Only a save that writes in place without shrinking it succeeds;
+// it shows through the mapping, where Read parses every line again and skips those that are no longer
+// items, so the index only goes stale until reloading rescans it.
+#define DOCUMENT_BLOCK_ITEMS        1024            // items per block at most, the unit of culling and reading
+#define DOCUMENT_SCAN_WINDOW        (16u << 20)     // bytes scanned as a unit at least, by one worker when loading in the background
+#define DOCUMENT_PREVIEW_ITEMS      65536           // items recorded for a view at most; a denser view leaves the rest out
+#define DOCUMENT_CHUNK_LINES        4096            // lines per chunk on average, a power of two
+#define DOCUMENT_CHUNK_MIN_BYTES    (16u << 10)     // chunks end no sooner, which bounds their number
+#define DOCUMENT_COPY_BYTES         (64u << 20)     // documents up to this size are copied rather than mapped
+
+// A pack is a document compiled to open without parsing: its block index, fixed size item records and
+// labels sit in page aligned sections listed in its header, and are read in place from the mapping. It
+// lives next to the source as source + DOCUMENT_PACK_EXTENSION and is only used while the source keeps
+// the size and write time it was compiled from.
+#define DOCUMENT_PACK_EXTENSION     L".pack"
+
+struct DocumentItem
+{
+    RasterRect rect;
+    uint32_t color;
+    const char* label;      // in the mapping, not terminated
+    uint32_t labelLength;
+};
+
+struct DocumentBlock
+{
+    uint64_t offset;        // of the first item line; in a pack, the index of the first item
+    uint64_t size;          // bytes up to the end of the last item line; in a pack, the offset of its labels
+    uint32_t items;
+    RasterRect bounds;      // of its items
+};
+
+struct DocumentChunk
+{
+    uint64_t hash;          // of its bytes
+    uint64_t offset;        // of its first line
+    uint64_t size;
+    uint64_t lines;
+    uint64_t items;
+    uint32_t firstBlock;    // in the window, then in the document once appended
+    uint32_t blockCount;
+};
+
+// The lines starting inside [begin, end) of a document
+struct DocumentWindow
+{
+    uint64_t begin;
+    uint64_t end;
+    uint64_t lines;
+    uint64_t invalidLine;   // first line that is not an item, counted from the window start; 0 when all are
+    uint64_t items;
+    uint64_t reused;        // bytes of chunks indexed in the previous version
+    std::vector<DocumentBlock> blocks;
+    std::vector<DocumentChunk> chunks;
+};
+
+struct DocumentPackItem;
+
+// Called from Open after every scanned window with the bytes scanned so far
+typedef void (*DocumentProgress)(void* context, uint64_t scanned, uint64_t size);
+
+class Document
+{
+public:
+    Document();
+    ~Document();
+
+    // Maps path and indexes its items; logs the first invalid line and returns false when it is not a document
+    bool Open(const wchar_t* path, DocumentProgress progress = nullptr, void* context = nullptr);
+    void Close();
+
+    // Maps the pack of source in its place when there is one up to date with it; false otherwise,
+    // leaving nothing open
+    bool OpenPack(const wchar_t* source);
+
+    // Maps path without indexing anything; windows scanned elsewhere are added with Append
+    bool Map(const wchar_t* path);
+
+    // Exchanges everything with other, which must not be in use by another thread
+    void Swap(Document& other);
+
+    // Where the window starting at begin ends: on the first chunk boundary DOCUMENT_SCAN_WINDOW bytes
+    // on, or on the next line when there is none within another DOCUMENT_SCAN_WINDOW; any thread
+    uint64_t WindowEnd(uint64_t begin) const;
+
+    // Faults the pages of window in; any thread
+    void Prefetch(const DocumentWindow& window) const;
+
+    // Indexes the lines starting in window into its blocks and chunks, taking the blocks of chunks
+    // found in previous rather than parsing them again; any thread, as long as previous does not change
+    void Scan(DocumentWindow& window, const Document* previous = nullptr) const;
+
+    // Drops the pages of window from the working set once scanned; reading a block faults them in again
+    void Trim(const DocumentWindow& window) const;
+
+    // Adds the blocks of the window following the last one added; logs and returns false when it holds
+    // an invalid line. Blocks never move once added, so another thread may read the first n while more
+    // are appended, as long as it learned of n after they were.
+    bool Append(DocumentWindow& window);
+
+    bool IsOpen() const { return file != INVALID_HANDLE_VALUE || copied; }
+    uint64_t Size() const { return size; }
+    uint64_t Indexed() const { return indexed; }
+    uint64_t Items() const { return itemCount; }
+    uint64_t Reused() const { return reused; }
+    bool Packed() const { return packItems != nullptr; }
+    RasterRect Bounds() const { return bounds; }
+    const std::vector<DocumentBlock>& Blocks() const { return blocks; }
+
+    // Parses the items of block into items, replacing its contents
+    void Read(const DocumentBlock& block, std::vector<DocumentItem>& items) const;
+
+    // The chunk of these bytes, nullptr when there is none
+    const DocumentChunk* FindChunk(uint64_t hash, uint64_t bytes) const;
+
+private:
+    // Adds the line in [line, next) to block, pushed to window once full; false when it is not valid
+    bool IndexLine(const char* line, const char* next, uint64_t lineInChunk, DocumentWindow& window, DocumentChunk& chunk,
+                   DocumentBlock& block) const;
+
+    HANDLE file;
+    HANDLE mapping;
+    const char* data;
+    bool copied;            // data is a private copy and the file is closed
+    uint64_t size;
+    uint64_t indexed;       // bytes of the windows added
+    uint64_t lines;
+    uint64_t itemCount;
+    uint64_t reused;        // bytes of the windows added that were indexed in the previous version
+    RasterRect bounds;
+    std::vector<DocumentBlock> blocks;
+    std::vector<DocumentChunk> chunks;
+    std::unordered_map<uint64_t, uint32_t> chunkIndex;  // by hash
+    const DocumentPackItem* packItems;  // in the mapping of a pack
+    const char* packLabels;
+    uint64_t packLabelBytes;
+};
+
+enum class DocumentLoad
+{
+    Idle,
+    Loading,
+    Done,
+    Failed
+};
+
+// Indexes a document in the background. A prefetch thread faults windows in ahead of the workers
+// that scan them, never more than one window per worker plus two past the last one committed, which
+// bounds the working set; workers finish windows in any order and Commit adds them to the document
+// in file order on the thread that owns it, so that thread never waits on the disk or a parse.
+class DocumentLoader
+{
+public:
+    DocumentLoader();
+    ~DocumentLoader();
+
+    // Maps path into document and starts indexing it with workers threads, 0 for one per core less two
+    // for the update and render threads; wake is set whenever a window is ready to commit. Chunks that
+    // previous, an earlier version of the document, has indexed are not parsed again; it must not
+    // change until the load is over.
+    bool Start(Document* document, const wchar_t* path, uint32_t workers, HANDLE wake, const Document* previous = nullptr);
+
+    // Starts indexing a document Map has already opened, so the caller can map it before handing it over
+    bool Start(Document* document, uint32_t workers, HANDLE wake, const Document* previous = nullptr);
+
+    // Adds the windows scanned so far to the document; Loading until all are, then Done or Failed once.
+    // A failed document is left open with the windows before the invalid line.
+    DocumentLoad Commit();
+
+    // Stops the threads; the document keeps the windows committed so far
+    void Cancel();
+
+    bool Loading() const { return document != nullptr; }
+
+private:
+    static int PrefetchMain(void* data);
+    static int WorkerMain(void* data);
+
+    Document* document;
+    const Document* previous;
+    HANDLE wake;
+    std::vector<SDL_Thread*> threads;
+    uint32_t inFlight;                  // windows prefetched and not yet committed, at most
+
+    // shared with the threads
+    SDL_mutex* mutex;
+    SDL_cond* changed;
+    std::vector<DocumentWindow> windows;    // as many as the document may need; the prefetch thread places them
+    uint32_t windowCount;               // lowered once the prefetch thread reaches the end
+    std::vector<uint8_t> scanned;       // per window
+    std::deque<uint32_t> ready;         // prefetched windows waiting for a worker
+    uint32_t prefetched;
+    uint32_t committed;
+    bool stopping;
+};
+
+// Records the items of the first blocks of document that intersect view as blends, DOCUMENT_PREVIEW_ITEMS
+// at most; items is scratch space. Returns the number recorded.
+uint32_t RecordDocumentPreview(const Document& document, uint32_t blocks, RasterRect view, CommandBuffer& commands,
+                               std::vector<DocumentItem>& items);
+
+// Compiles the document source into the pack at path pack, replacing it only once complete; logs and
+// returns false when source is not a document
+bool CompileDocument(const wchar_t* source, const wchar_t* pack);
+
+// Generates documents of 100 MB, 1 GB and 8 GB, or of megabytes if not 0, in the temporary directory
+// and logs the time and peak working set of opening each against reading it into memory
+void BenchmarkDocument(uint32_t megabytes);
+
+// Loads a generated document of megabytes, 1 GB if 0, in the background under a 60 Hz frame loop that
+// commits and draws the preview, and logs frame time percentiles against opening it synchronously
+void BenchmarkDocumentLoader(uint32_t megabytes);
+
+// Reloads a generated document of megabytes, 1 GB if 0, after edits to a growing share of it saved in place
+// over it while it is mapped, and logs the reload time and the bytes reused against loading it in full
+void BenchmarkDocumentReload(uint32_t megabytes);
+
+// Compiles a generated document of megabytes, 1 GB if 0, and logs the time from opening it to its first
+// frame against opening its pack
+void BenchmarkDocumentPack(uint32_t megabytes);
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <windows.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <SDL.h>
+
+
+// Paces the render loop to a target frame rate and advances the simulation in fixed ticks that are
+// independent of it; frames render between the last two ticks as of TickCounter(). Waiting sleeps for
+// most of the remaining frame and spins through the last stretch, because Sleep only wakes on
+// timer ticks (1 ms at best, which SDL requests through SDL_HINT_TIMER_RESOLUTION).
+#define FRAME_SCHEDULER_SPIN_MS         2       // busy wait this close to a deadline instead of sleeping
+#define FRAME_SCHEDULER_MAX_TICKS       8       // ticks per frame at most, so a stall does not snowball
+#define FRAME_SCHEDULER_REPORT_MS       5000    // frame time percentile logging interval
+
+class FrameScheduler
+{
+public:
+    // frameRate 0 renders unthrottled
+    FrameScheduler(uint32_t frameRate, uint32_t tickRate)
+    {
+        frequency = SDL_GetPerformanceFrequency();
+        framePeriod = frameRate > 0 ? frequency / frameRate : 0;
+        tickPeriod = frequency / tickRate;
+        reportTime = 0;
+        Reset();
+    }
+
+    // Forgets time spent outside the loop, e.g. while blocked waiting for work
+    void Reset()
+    {
+        lastTime = SDL_GetPerformanceCounter();
+        deadline = lastTime + framePeriod;
+        lastFrame = 0;
+        accumulator = 0;
+    }
+
+    // Returns the number of fixed ticks to simulate before rendering this frame
+    uint32_t BeginFrame()
+    {
+        Uint64 now = SDL_GetPerformanceCounter();
+        accumulator += now - lastTime;
+        lastTime = now;
+
+        uint32_t ticks = (uint32_t)SDL_min(accumulator / tickPeriod, (Uint64)FRAME_SCHEDULER_MAX_TICKS);
+        accumulator = SDL_min(accumulator - ticks * tickPeriod, tickPeriod - 1);
+        return ticks;
+    }
+
+    // Performance counter at which the latest tick was due
+    Uint64 TickCounter() const
+    {
+        return lastTime - accumulator;
+    }
+
+    // Milliseconds until the next tick is due, rounded up
+    Uint32 UntilNextTick() const
+    {
+        Uint64 owed = accumulator + (SDL_GetPerformanceCounter() - lastTime);
+        if (owed >= tickPeriod) return 0;
+        return (Uint32)(((tickPeriod - owed) * 1000 + frequency - 1) / frequency);
+    }
+
+    double TickSeconds() const
+    {
+        return (double)tickPeriod / (double)frequency;
+    }
+
+    // Waits for the next frame deadline and records the resulting frame time
+    void WaitForNextFrame()
+    {
+        if (framePeriod > 0)
+        {
+            Uint64 now = SDL_GetPerformanceCounter();
+            Uint64 spin = frequency * FRAME_SCHEDULER_SPIN_MS / 1000;
+
+            if (deadline > now + spin)
+            {
+                SDL_Delay((Uint32)((deadline - now - spin) * 1000 / frequency));
+            }
+
+            while (SDL_GetPerformanceCounter() < deadline)
+            {
+                YieldProcessor();
+            }
+
+            // Keep deadlines on a fixed grid, but start over instead of bursting frames after falling behind
+            deadline += framePeriod;
+            now = SDL_GetPerformanceCounter();
+            if (deadline < now) deadline = now + framePeriod;
+        }
+
+        RecordFrame();
+    }
+
+private:
+    void RecordFrame()
+    {
+        Uint64 now = SDL_GetPerformanceCounter();
+
+        if (lastFrame != 0)
+        {
+            frameTimes.push_back((float)((double)(now - lastFrame) * 1000.0 / (double)frequency));
+        }
+        else if (frameTimes.empty())
+        {
+            reportTime = now;
+        }
+
+        lastFrame = now;
+
+        if (now - reportTime >= frequency * FRAME_SCHEDULER_REPORT_MS / 1000 && !frameTimes.empty())
+        {
+            std::sort(frameTimes.begin(), frameTimes.end());
+            size_t count = frameTimes.size();
+
+            SDL_Log("Frame times over %u frames: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms",
+                    (unsigned)count, frameTimes[count / 2], frameTimes[count * 90 / 100], frameTimes[count * 99 / 100], frameTimes[count - 1]);
+
+            frameTimes.clear();
+            reportTime = now;
+        }
+    }
+
+    Uint64 frequency;
+    Uint64 framePeriod;
+    Uint64 tickPeriod;
+    Uint64 lastTime;        // last BeginFrame
+    Uint64 accumulator;     // simulated time owed, less than one tick after BeginFrame
+    Uint64 deadline;        // next frame start when throttled
+    Uint64 lastFrame;       // previous frame start, 0 after Reset
+    Uint64 reportTime;
+    std::vector<float> frameTimes;
+};
@@ -0,0 +1,184 @@
+#include "GlState.h"
+
+#include <string.h>
+
+GlState::GlState()
+    : bindBuffer(nullptr), bindFramebuffer(nullptr), bindRenderbuffer(nullptr), useProgram(nullptr), issued(0), elided(0)
+{
+    Invalidate();
+}
+
+void GlState::Initialize()
+{
+    bindBuffer = (PFNGLBINDBUFFERPROC)SDL_GL_GetProcAddress("glBindBuffer");
+    bindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC)SDL_GL_GetProcAddress("glBindFramebuffer");
+    bindRenderbuffer = (PFNGLBINDRENDERBUFFERPROC)SDL_GL_GetProcAddress("glBindRenderbuffer");
+    useProgram = (PFNGLUSEPROGRAMPROC)SDL_GL_GetProcAddress("glUseProgram");
+    Invalidate();
+}
+
+void GlState::Invalidate()
+{
+    // No real value matches these, so the next call of each kind is issued
+    for (int i = 0; i < 4; ++i)
+    {
+        clearColor[i] = -1.0f;
+        viewport[i] = -1;
+        scissor[i] = -1;
+    }
+
+    blend = GL_STATE_UNKNOWN;
+    scissorTest = GL_STATE_UNKNOWN;
+    texture2D = GL_STATE_UNKNOWN;
+    blendSource = GL_INVALID_ENUM;
+    blendDestination = GL_INVALID_ENUM;
+    texture = GL_STATE_UNKNOWN;
+    arrayBuffer = GL_STATE_UNKNOWN;
+    elementBuffer = GL_STATE_UNKNOWN;
+    framebuffer = GL_STATE_UNKNOWN;
+    renderbuffer = GL_STATE_UNKNOWN;
+    program = GL_STATE_UNKNOWN;
+    projection[0] = -1;
+    projection[1] = -1;
+}
+
+bool GlState::Changed(bool same, uint32_t calls)
+{
+    if (same)
+    {
+        elided += calls;
+        return false;
+    }
+
+    issued += calls;
+    return true;
+}
+
+int32_t* GlState::Capability(GLenum capability)
+{
+    switch (capability)
+    {
+        case GL_BLEND: return &blend;
+        case GL_SCISSOR_TEST: return &scissorTest;
+        case GL_TEXTURE_2D: return &texture2D;
+    }
+    return nullptr;
+}
+
+void GlState::ClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    GLfloat color[4] = { red, green, blue, alpha };
+    if (!Changed(memcmp(color, clearColor, sizeof(color)) == 0)) return;
+
+    memcpy(clearColor, color, sizeof(color));
+    glClearColor(red, green, blue, alpha);
+}
+
+void GlState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    GLint rect[4] = { x, y, width, height };
+    if (!Changed(memcmp(rect, viewport, sizeof(rect)) == 0)) return;
+
+    memcpy(viewport, rect, sizeof(rect));
+    glViewport(x, y, width, height);
+}
+
+void GlState::Scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    GLint rect[4] = { x, y, width, height };
+    if (!Changed(memcmp(rect, scissor, sizeof(rect)) == 0)) return;
+
+    memcpy(scissor, rect, sizeof(rect));
+    glScissor(x, y, width, height);
+}
+
+void GlState::Enable(GLenum capability)
+{
+    int32_t* enabled = Capability(capability);
+    if (!Changed(enabled != nullptr && *enabled == 1)) return;
+
+    if (enabled) *enabled = 1;
+    glEnable(capability);
+}
+
+void GlState::Disable(GLenum capability)
+{
+    int32_t* enabled = Capability(capability);
+    if (!Changed(enabled != nullptr && *enabled == 0)) return;
+
+    if (enabled) *enabled = 0;
+    glDisable(capability);
+}
+
+void GlState::BlendFunc(GLenum source, GLenum destination)
+{
+    if (!Changed(source == blendSource && destination == blendDestination)) return;
+
+    blendSource = source;
+    blendDestination = destination;
+    glBlendFunc(source, destination);
+}
+
+void GlState::BindTexture(GLenum target, GLuint name)
+{
+    bool tracked = target == GL_TEXTURE_2D;
+    if (!Changed(tracked && texture == name)) return;
+
+    if (tracked) texture = name;
+    glBindTexture(target, name);
+}
+
+void GlState::BindBuffer(GLenum target, GLuint buffer)
+{
+    int64_t* bound = target == GL_ARRAY_BUFFER ? &arrayBuffer : target == GL_ELEMENT_ARRAY_BUFFER ? &elementBuffer : nullptr;
+    if (!Changed(bound != nullptr && *bound == buffer)) return;
+
+    if (bound) *bound = buffer;
+    bindBuffer(target, buffer);
+}
+
+void GlState::BindFramebuffer(GLenum target, GLuint name)
+{
+    // Only GL_FRAMEBUFFER binds both the draw and the read framebuffer
+    bool tracked = target == GL_FRAMEBUFFER;
+    if (!Changed(tracked && framebuffer == name)) return;
+
+    framebuffer = tracked ? (int64_t)name : GL_STATE_UNKNOWN;
+    bindFramebuffer(target, name);
+}
+
+void GlState::BindRenderbuffer(GLenum target, GLuint name)
+{
+    if (!Changed(renderbuffer == name)) return;
+
+    renderbuffer = name;
+    bindRenderbuffer(target, name);
+}
+
+void GlState::UseProgram(GLuint name)
+{
+    if (!Changed(program == name)) return;
+
+    program = name;
+    useProgram(name);
+}
+
+void GlState::PixelProjection(GLsizei width, GLsizei height)
+{
+    if (!Changed(projection[0] == width && projection[1] == height, 5)) return;
+
+    projection[0] = width;
+    projection[1] = height;
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0, width, 0, height, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+}
+
+void GlState::ResetCounters()
+{
+    issued = 0;
+    elided = 0;
+}
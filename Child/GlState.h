@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <SDL.h>
+#include <SDL_opengl.h>
+
+
+// Shadows the GL state Child changes and only forwards calls that change it. Each call counts as
+// issued or elided, so redundant state changes show up in the frame statistics. The shadow must be
+// invalidated whenever a context becomes current, since another thread may have changed it meanwhile.
+#define GL_STATE_UNKNOWN    -1
+
+class GlState
+{
+public:
+    GlState();
+
+    // Loads the entry points of the bind calls and forgets all state; call with the context current
+    void Initialize();
+    void Invalidate();
+
+    void ClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+    void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void Scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    // GL_BLEND, GL_SCISSOR_TEST and GL_TEXTURE_2D are tracked, anything else is passed through
+    void Enable(GLenum capability);
+    void Disable(GLenum capability);
+
+    void BlendFunc(GLenum source, GLenum destination);
+    void BindTexture(GLenum target, GLuint texture);
+    void BindBuffer(GLenum target, GLuint buffer);
+    void BindFramebuffer(GLenum target, GLuint framebuffer);
+    void BindRenderbuffer(GLenum target, GLuint renderbuffer);
+    void UseProgram(GLuint program);
+
+    // Projection mapping framebuffer pixels with a bottom-up y, identity modelview
+    void PixelProjection(GLsizei width, GLsizei height);
+
+    // Driver calls made and avoided since the last reset
+    uint64_t Issued() const { return issued; }
+    uint64_t Elided() const { return elided; }
+    void ResetCounters();
+
+private:
+    // Counts the outcome and returns true when the call has to reach the driver
+    bool Changed(bool same, uint32_t calls = 1);
+    int32_t* Capability(GLenum capability);
+
+    PFNGLBINDBUFFERPROC bindBuffer;
+    PFNGLBINDFRAMEBUFFERPROC bindFramebuffer;
+    PFNGLBINDRENDERBUFFERPROC bindRenderbuffer;
+    PFNGLUSEPROGRAMPROC useProgram;
+
+    GLfloat clearColor[4];
+    GLint viewport[4];
+    GLint scissor[4];
+    int32_t blend;          // 0, 1 or GL_STATE_UNKNOWN
+    int32_t scissorTest;
+    int32_t texture2D;
+    GLenum blendSource;
+    GLenum blendDestination;
+    int64_t texture;        // bound to GL_TEXTURE_2D
+    int64_t arrayBuffer;
+    int64_t elementBuffer;
+    int64_t framebuffer;
+    int64_t renderbuffer;
+    int64_t program;
+    GLsizei projection[2];
+
+    uint64_t issued;
+    uint64_t elided;
+};
@@ -0,0 +1,326 @@
+#include "ProgramCache.h"
+
+#include <windows.h>
+
+#include <string.h>
+#include <vector>
+
+#include "CommandBuffer.h"
+#include "GlState.h"
+#include "QuadBatch.h"
+
+// Entry points for building programs, all part of OpenGL 2.0
+#define PROGRAM_GL_FUNCTIONS(X) \
+    X(PFNGLCREATESHADERPROC, glCreateShader) \
+    X(PFNGLSHADERSOURCEPROC, glShaderSource) \
+    X(PFNGLCOMPILESHADERPROC, glCompileShader) \
+    X(PFNGLGETSHADERIVPROC, glGetShaderiv) \
+    X(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog) \
+    X(PFNGLDELETESHADERPROC, glDeleteShader) \
+    X(PFNGLCREATEPROGRAMPROC, glCreateProgram) \
+    X(PFNGLATTACHSHADERPROC, glAttachShader) \
+    X(PFNGLLINKPROGRAMPROC, glLinkProgram) \
+    X(PFNGLGETPROGRAMIVPROC, glGetProgramiv) \
+    X(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog) \
+    X(PFNGLDELETEPROGRAMPROC, glDeleteProgram)
+
+#define PROGRAM_GL_DECLARE(type, name) static type name = nullptr;
+#define PROGRAM_GL_LOAD(type, name) name = (type)SDL_GL_GetProcAddress(#name); if (name == nullptr) return false;
+
+PROGRAM_GL_FUNCTIONS(PROGRAM_GL_DECLARE)
+
+// OpenGL 4.1 or ARB_get_program_binary; without them the cache stays disabled
+static PFNGLPROGRAMPARAMETERIPROC glProgramParameteri = nullptr;
+static PFNGLGETPROGRAMBINARYPROC glGetProgramBinary = nullptr;
+static PFNGLPROGRAMBINARYPROC glProgramBinary = nullptr;
+
+static bool LoadProgramFunctions()
+{
+    PROGRAM_GL_FUNCTIONS(PROGRAM_GL_LOAD)
+
+    glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)SDL_GL_GetProcAddress("glProgramParameteri");
+    glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)SDL_GL_GetProcAddress("glGetProgramBinary");
+    glProgramBinary = (PFNGLPROGRAMBINARYPROC)SDL_GL_GetProcAddress("glProgramBinary");
+    return true;
+}
+
+static GLuint CompileShader(GLenum type, const char* source)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+
+    if (!compiled)
+    {
+        char log[1024] = "";
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        SDL_Log("Unable to compile shader: %s", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// SDL hands out UTF-8 paths, Win32 file calls want UTF-16
+static std::wstring WidePath(const std::string& path)
+{
+    int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+    std::wstring wide(length > 0 ? length : 1, L'\0');
+    if (length > 0) MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide[0], length);
+    return wide;
+}
+
+ProgramCache::ProgramCache()
+    : enabled(false), hits(0), misses(0), rejected(0)
+{
+}
+
+bool ProgramCache::Initialize()
+{
+    enabled = false;
+
+    if (!LoadProgramFunctions() || glProgramParameteri == nullptr || glGetProgramBinary == nullptr || glProgramBinary == nullptr)
+    {
+        return false;
+    }
+
+    // Drivers may support the calls and still offer no format
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0) return false;
+
+    char* path = SDL_GetPrefPath("ParentChildProcSDL", "Child");
+    if (path == nullptr)
+    {
+        SDL_Log("No directory for the program cache: %s", SDL_GetError());
+        return false;
+    }
+
+    directory = path;
+    SDL_free(path);
+
+    // Another driver, or another version of it, may accept an old binary and still misbehave
+    const GLenum identity[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+    driver.clear();
+    for (GLenum name : identity)
+    {
+        const char* value = (const char*)glGetString(name);
+        driver += value ? value : "";
+        driver += '\n';
+    }
+
+    enabled = true;
+    return true;
+}
+
+std::string ProgramCache::Path(const char* name) const
+{
+    return directory + "program-" + name + ".bin";
+}
+
+GLuint ProgramCache::Build(const char* name, const char* vertexSource, const char* fragmentSource)
+{
+    if (!LoadProgramFunctions()) return 0;
+
+    // Each source with its terminator, so moving text from one into the other changes the key
+    uint64_t key = 0;
+    if (enabled)
+    {
+        key = CommandHash(driver.data(), driver.size());
+        key = CommandHash(vertexSource, strlen(vertexSource) + 1, key);
+        key = CommandHash(fragmentSource, strlen(fragmentSource) + 1, key);
+
+        GLuint program = Load(name, key);
+        if (program)
+        {
+            hits++;
+            return program;
+        }
+    }
+
+    misses++;
+    GLuint program = Compile(vertexSource, fragmentSource);
+    if (program && enabled) Save(name, key, program);
+    return program;
+}
+
+GLuint ProgramCache::Load(const char* name, uint64_t key)
+{
+    std::string path = Path(name);
+    SDL_RWops* file = SDL_RWFromFile(path.c_str(), "rb");
+    if (file == nullptr) return 0;
+
+    // A missing or stale entry is a plain miss; a damaged one is rejected
+    ProgramCacheHeader header;
+    std::vector<uint8_t> binary;
+    bool present = SDL_RWread(file, &header, sizeof(header), 1) == 1 && header.key == key;
+    bool valid = present && header.magic == PROGRAM_CACHE_MAGIC && header.version == PROGRAM_CACHE_VERSION &&
+                 header.size > 0 && header.size <= PROGRAM_CACHE_MAX_BINARY;
+
+    if (valid)
+    {
+        binary.resize(header.size);
+        valid = SDL_RWread(file, binary.data(), header.size, 1) == 1 && CommandHash(binary.data(), binary.size()) == header.hash;
+    }
+
+    SDL_RWclose(file);
+
+    if (!present) return 0;
+    if (!valid)
+    {
+        SDL_Log("Cached %s program is damaged, compiling it", name);
+        rejected++;
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), header.size);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+    if (!linked)
+    {
+        SDL_Log("Driver refused the cached %s program, compiling it", name);
+        glDeleteProgram(program);
+        rejected++;
+        return 0;
+    }
+    return program;
+}
+
+GLuint ProgramCache::Compile(const char* vertexSource, const char* fragmentSource)
+{
+    // GLSL fails to compile on contexts older than its version even when the entry points exist
+    GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fragmentShader = vertexShader ? CompileShader(GL_FRAGMENT_SHADER, fragmentSource) : 0;
+
+    if (fragmentShader == 0)
+    {
+        if (vertexShader) glDeleteShader(vertexShader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    if (enabled) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+    if (!linked)
+    {
+        char log[1024] = "";
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        SDL_Log("Unable to link shader program: %s", log);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void ProgramCache::Save(const char* name, uint64_t key, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0 || (uint32_t)length > PROGRAM_CACHE_MAX_BINARY) return;
+
+    std::vector<uint8_t> binary(length);
+    GLsizei size = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &size, &format, binary.data());
+    if (size <= 0) return;
+
+    ProgramCacheHeader header = { PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, format, (uint32_t)size, key, CommandHash(binary.data(), size) };
+
+    // Pooled children start together; each writes its own file and renames it over the entry, so none reads a partial one
+    std::string path = Path(name);
+    std::string temporary = path + "." + std::to_string(GetCurrentProcessId());
+
+    SDL_RWops* file = SDL_RWFromFile(temporary.c_str(), "wb");
+    if (file == nullptr)
+    {
+        SDL_Log("Unable to write %s: %s", temporary.c_str(), SDL_GetError());
+        return;
+    }
+
+    bool written = SDL_RWwrite(file, &header, sizeof(header), 1) == 1 && SDL_RWwrite(file, binary.data(), size, 1) == 1;
+    SDL_RWclose(file);
+
+    if (!written || !MoveFileExW(WidePath(temporary).c_str(), WidePath(path).c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        SDL_Log("Unable to store the %s program in %s", name, path.c_str());
+        DeleteFileW(WidePath(temporary).c_str());
+    }
+}
+
+void ProgramCache::Forget(const char* name)
+{
+    if (enabled) DeleteFileW(WidePath(Path(name)).c_str());
+}
+
+void ProgramCache::ResetCounters()
+{
+    hits = 0;
+    misses = 0;
+    rejected = 0;
+}
+
+void BenchmarkProgramCache(GlState& state, uint32_t rounds)
+{
+    ProgramCache uncached;
+    ProgramCache cache;
+    if (!cache.Initialize())
+    {
+        SDL_Log("%s cannot return program binaries; startup always compiles", (const char*)glGetString(GL_RENDERER));
+        return;
+    }
+
+    SDL_Log("Quad batch startup with %s, %u rounds", (const char*)glGetString(GL_RENDERER), rounds);
+
+    // Compiling only; compiling and storing the binary; loading the stored binary
+    const char* names[] = { "no cache", "cold cache", "warm cache" };
+    double totals[3] = { 0.0, 0.0, 0.0 };
+
+    // The first initialization also pays for loading the compiler and creating driver state
+    QuadBatch warmup;
+    bool instanced = warmup.Initialize(&state, nullptr, QuadBackend::Instanced, &uncached) == QuadBackend::Instanced;
+    warmup.Release();
+
+    for (uint32_t round = 0; round < rounds && instanced; ++round)
+    {
+        for (int run = 0; run < 3; ++run)
+        {
+            if (run == 1) cache.Forget(QUAD_BATCH_PROGRAM);
+
+            QuadBatch batch;
+            Uint64 start = SDL_GetPerformanceCounter();
+            QuadBackend backend = batch.Initialize(&state, nullptr, QuadBackend::Instanced, run == 0 ? &uncached : &cache);
+            glFinish();
+            totals[run] += (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+
+            instanced = instanced && backend == QuadBackend::Instanced;
+            batch.Release();
+        }
+    }
+
+    if (!instanced)
+    {
+        SDL_Log("The instanced quad backend is not available");
+        return;
+    }
+
+    for (int run = 0; run < 3; ++run)
+    {
+        SDL_Log("%-10s %8.2f ms", names[run], totals[run] / rounds);
+    }
+    SDL_Log("%u binaries loaded, %u compiled, %u rejected", cache.Hits(), cache.Misses(), cache.Rejected());
+}
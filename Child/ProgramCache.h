@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include <SDL.h>
+#include <SDL_opengl.h>
+
+class GlState;
+
+
+// Builds GL programs from source and keeps the linked binaries on disk, one file per program name in
+// the user's pref path. A binary is only used when it was saved for the same sources and the same
+// vendor, renderer and driver version, its checksum matches and the driver accepts it; anything else
+// falls back to compiling, and the fresh binary replaces the file.
+#define PROGRAM_CACHE_MAGIC         0x42475250  // "PRGB"
+#define PROGRAM_CACHE_VERSION       1
+#define PROGRAM_CACHE_MAX_BINARY    (16u << 20) // larger files are not trusted
+
+// Prefixes a cached binary
+struct ProgramCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;    // as returned by glGetProgramBinary
+    uint32_t size;      // bytes of binary following the header
+    uint64_t key;       // sources and driver identity
+    uint64_t hash;      // of the binary
+};
+
+class ProgramCache
+{
+public:
+    ProgramCache();
+
+    // Uses the pref path when the driver can return program binaries; call with the context current.
+    // Without it, or before it, Build only compiles.
+    bool Initialize();
+    bool Enabled() const { return enabled; }
+
+    // Links a program from vertex and fragment source, from the binary cached under name when it
+    // still matches; returns 0 when compiling or linking fails
+    GLuint Build(const char* name, const char* vertexSource, const char* fragmentSource);
+
+    // Drops the binary cached under name, so the next build compiles
+    void Forget(const char* name);
+
+    // Builds since the last reset: binaries loaded, programs compiled and binaries that failed validation
+    uint32_t Hits() const { return hits; }
+    uint32_t Misses() const { return misses; }
+    uint32_t Rejected() const { return rejected; }
+    void ResetCounters();
+
+private:
+    std::string Path(const char* name) const;
+    GLuint Load(const char* name, uint64_t key);
+    GLuint Compile(const char* vertexSource, const char* fragmentSource);
+    void Save(const char* name, uint64_t key, GLuint program);
+
+    bool enabled;
+    std::string directory;
+    std::string driver;     // vendor, renderer and version strings
+
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t rejected;
+};
+
+// Times quad batch startup without the cache, with an empty cache and with a warm one over rounds
+// rounds; needs a current context
+void BenchmarkProgramCache(GlState& state, uint32_t rounds);
@@ -0,0 +1,572 @@
+#include "QuadBatch.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "GlState.h"
+#include "ProgramCache.h"
+#include "TileRenderer.h"
+
+// Entry points of the instanced backend, all part of OpenGL 3.3 except the persistent mapping of 4.4
+#define QUAD_GL_FUNCTIONS(X) \
+    X(PFNGLDELETEPROGRAMPROC, glDeleteProgram) \
+    X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation) \
+    X(PFNGLUNIFORM2FPROC, glUniform2f) \
+    X(PFNGLGENBUFFERSPROC, glGenBuffers) \
+    X(PFNGLDELETEBUFFERSPROC, glDeleteBuffers) \
+    X(PFNGLBUFFERDATAPROC, glBufferData) \
+    X(PFNGLBUFFERSUBDATAPROC, glBufferSubData) \
+    X(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays) \
+    X(PFNGLDELETEVERTEXARRAYSPROC, glDeleteVertexArrays) \
+    X(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray) \
+    X(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer) \
+    X(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray) \
+    X(PFNGLVERTEXATTRIBDIVISORPROC, glVertexAttribDivisor) \
+    X(PFNGLDRAWARRAYSINSTANCEDPROC, glDrawArraysInstanced) \
+    X(PFNGLFENCESYNCPROC, glFenceSync) \
+    X(PFNGLCLIENTWAITSYNCPROC, glClientWaitSync) \
+    X(PFNGLDELETESYNCPROC, glDeleteSync)
+
+#define QUAD_GL_DECLARE(type, name) static type name = nullptr;
+#define QUAD_GL_LOAD(type, name) name = (type)SDL_GL_GetProcAddress(#name); if (name == nullptr) return false;
+
+QUAD_GL_FUNCTIONS(QUAD_GL_DECLARE)
+static PFNGLBUFFERSTORAGEPROC glBufferStorage = nullptr;
+static PFNGLMAPBUFFERRANGEPROC glMapBufferRange = nullptr;
+
+static GLuint whiteTexture = 0;     // bound for untextured materials, so one shader serves all
+
+static const char* vertexShaderSource =
+    "#version 330\n"
+    "layout(location = 0) in vec4 rect;\n"
+    "layout(location = 1) in vec4 uv;\n"
+    "layout(location = 2) in vec4 left;\n"
+    "layout(location = 3) in vec4 right;\n"
+    "uniform vec2 viewport;\n"
+    "out vec2 texcoord;\n"
+    "out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+    "    gl_Position = vec4((rect.xy + corner * rect.zw) / viewport * 2.0 - 1.0, 0.0, 1.0);\n"
+    "    texcoord = mix(uv.xy, uv.zw, corner);\n"
+    "    color = mix(left, right, corner.x);\n"
+    "}\n";
+
+static const char* fragmentShaderSource =
+    "#version 330\n"
+    "uniform sampler2D image;\n"
+    "in vec2 texcoord;\n"
+    "in vec4 color;\n"
+    "out vec4 fragment;\n"
+    "void main()\n"
+    "{\n"
+    "    fragment = color * texture(image, texcoord);\n"
+    "}\n";
+
+static bool LoadInstancedFunctions()
+{
+    QUAD_GL_FUNCTIONS(QUAD_GL_LOAD)
+
+    // Optional; without it every region is orphaned and rewritten instead
+    glBufferStorage = (PFNGLBUFFERSTORAGEPROC)SDL_GL_GetProcAddress("glBufferStorage");
+    glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)SDL_GL_GetProcAddress("glMapBufferRange");
+    return true;
+}
+
+static GLuint CreateTexture(const RasterImage& image)
+{
+    GLuint name = 0;
+    glGenTextures(1, &name);
+    glBindTexture(GL_TEXTURE_2D, name);
+
+    // Nearest sampling, like the CPU rasterizer
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image.stride);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0, GL_BGRA, GL_UNSIGNED_BYTE, image.pixels);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    return name;
+}
+
+QuadBatch::QuadBatch()
+    : backend(QuadBackend::Cpu), state(nullptr), renderer(nullptr), program(0), vertexArray(0), buffer(0),
+      viewportLocation(-1), mapped(nullptr), fences(), region(0), drawCalls(0), quadCount(0)
+{
+    histogram.resize(65536);
+}
+
+QuadBatch::~QuadBatch()
+{
+    // GL objects belong to the context, which is usually gone by now; Release frees them while it is current
+}
+
+QuadBackend QuadBatch::Initialize(GlState* glState, TileRenderer* tileRenderer, QuadBackend limit, ProgramCache* programs)
+{
+    // A CPU limit leaves GL alone even when a state is given
+    state = limit == QuadBackend::Cpu ? nullptr : glState;
+    renderer = tileRenderer;
+    backend = QuadBackend::Cpu;
+
+    if (state == nullptr) return backend;
+
+    if (whiteTexture == 0)
+    {
+        uint32_t white = 0xFFFFFFFF;
+        RasterImage image = { &white, 1, 1, 1 };
+        whiteTexture = CreateTexture(image);
+        state->Invalidate();
+    }
+
+    // Textures registered before the backend changed still need a GL name
+    for (Texture& texture : textures)
+    {
+        if (texture.name == 0) texture.name = CreateTexture(*texture.image);
+    }
+
+    backend = limit == QuadBackend::Instanced && InitializeInstanced(programs) ? QuadBackend::Instanced : QuadBackend::Immediate;
+    return backend;
+}
+
+bool QuadBatch::InitializeInstanced(ProgramCache* programs)
+{
+    if (!LoadInstancedFunctions()) return false;
+
+    // Without a cache every start compiles
+    ProgramCache compiler;
+    program = (programs ? programs : &compiler)->Build(QUAD_BATCH_PROGRAM, vertexShaderSource, fragmentShaderSource);
+    if (program == 0) return false;
+
+    viewportLocation = glGetUniformLocation(program, "viewport");
+
+    // One array of instances; the divisor advances every attribute once per quad
+    glGenVertexArrays(1, &vertexArray);
+    glBindVertexArray(vertexArray);
+    glGenBuffers(1, &buffer);
+    state->BindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    for (GLuint attribute = 0; attribute < 4; ++attribute)
+    {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+
+    GLsizeiptr size = (GLsizeiptr)QUAD_BATCH_CAPACITY * QUAD_BATCH_REGIONS * sizeof(Quad);
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    if (glBufferStorage != nullptr && glMapBufferRange != nullptr)
+    {
+        glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        mapped = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    }
+
+    glBindVertexArray(0);
+    return true;
+}
+
+void QuadBatch::Release()
+{
+    if (backend == QuadBackend::Instanced)
+    {
+        for (GLsync& fence : fences)
+        {
+            if (fence) glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        state->UseProgram(0);
+        glDeleteBuffers(1, &buffer);
+        glDeleteVertexArrays(1, &vertexArray);
+        glDeleteProgram(program);
+        state->Invalidate();
+        buffer = 0;
+        vertexArray = 0;
+        program = 0;
+        mapped = nullptr;
+    }
+
+    if (backend != QuadBackend::Cpu)
+    {
+        for (Texture& texture : textures)
+        {
+            if (texture.name) glDeleteTextures(1, &texture.name);
+            texture.name = 0;
+        }
+        state->Invalidate();
+    }
+
+    backend = QuadBackend::Cpu;
+}
+
+const char* QuadBatch::BackendName() const
+{
+    switch (backend)
+    {
+        case QuadBackend::Cpu: return "CPU";
+        case QuadBackend::Immediate: return "immediate GL";
+        case QuadBackend::Instanced: return mapped ? "instanced GL, persistent" : "instanced GL, orphaned";
+    }
+    return "";
+}
+
+uint32_t QuadBatch::AddTexture(const RasterImage* image)
+{
+    if (textures.size() >= QUAD_BATCH_MAX_TEXTURES) return 0;
+
+    Texture texture = { image, 0 };
+    if (backend != QuadBackend::Cpu)
+    {
+        texture.name = CreateTexture(*image);
+        state->Invalidate();
+    }
+
+    textures.push_back(texture);
+    return (uint32_t)textures.size();
+}
+
+void QuadBatch::UpdateTexture(uint32_t texture, RasterRect area)
+{
+    // The CPU backend reads the image itself
+    if (backend == QuadBackend::Cpu || texture == 0 || texture > textures.size()) return;
+
+    const Texture& entry = textures[texture - 1];
+    const RasterImage& image = *entry.image;
+    int32_t x0 = SDL_max(area.x, 0);
+    int32_t y0 = SDL_max(area.y, 0);
+    int32_t x1 = SDL_min(area.x + area.width, image.width);
+    int32_t y1 = SDL_min(area.y + area.height, image.height);
+    if (x1 <= x0 || y1 <= y0) return;
+
+    state->BindTexture(GL_TEXTURE_2D, entry.name);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image.stride);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x0, y0, x1 - x0, y1 - y0, GL_BGRA, GL_UNSIGNED_BYTE,
+                    image.pixels + (size_t)y0 * image.stride + x0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+void QuadBatch::Add(const Quad& quad, uint32_t texture, uint32_t layer)
+{
+    if (texture > textures.size()) texture = 0;
+    if (layer >= QUAD_BATCH_MAX_LAYERS) layer = QUAD_BATCH_MAX_LAYERS - 1;
+
+    // Textures may be translucent anywhere, colors are known
+    bool blend = texture != 0 || (quad.left >> 24) != 0xFF || (quad.right >> 24) != 0xFF;
+    uint64_t material = texture << 1 | (blend ? 1 : 0);
+
+    keys.push_back((uint64_t)layer << 48 | material << 32 | quads.size());
+    quads.push_back(quad);
+}
+
+void QuadBatch::Add(RasterRect rect, uint32_t color, uint32_t layer)
+{
+    Quad quad = { (float)rect.x, (float)rect.y, (float)rect.width, (float)rect.height, 0.0f, 0.0f, 1.0f, 1.0f, color, color };
+    Add(quad, 0, layer);
+}
+
+void QuadBatch::Sort()
+{
+    // Usually submitted in order already
+    bool sorted = true;
+    for (size_t i = 1; i < keys.size() && sorted; ++i)
+    {
+        sorted = keys[i - 1] <= keys[i];
+    }
+    if (sorted) return;
+
+    // Stable radix sort on material, then layer; the index in the low bits keeps submission order within a key
+    sortBuffer.resize(keys.size());
+
+    for (int shift = 32; shift < 64; shift += 16)
+    {
+        std::fill(histogram.begin(), histogram.end(), 0);
+        for (uint64_t key : keys)
+        {
+            histogram[key >> shift & 0xFFFF]++;
+        }
+
+        // Every key has the same digit
+        if (histogram[keys[0] >> shift & 0xFFFF] == keys.size()) continue;
+
+        uint32_t offset = 0;
+        for (uint32_t& count : histogram)
+        {
+            uint32_t next = offset + count;
+            count = offset;
+            offset = next;
+        }
+
+        for (uint64_t key : keys)
+        {
+            sortBuffer[histogram[key >> shift & 0xFFFF]++] = key;
+        }
+        keys.swap(sortBuffer);
+    }
+}
+
+void QuadBatch::Flush(int32_t width, int32_t height)
+{
+    if (quads.empty()) return;
+
+    Sort();
+    quadCount += quads.size();
+
+    switch (backend)
+    {
+        case QuadBackend::Cpu: FlushCpu(); break;
+        case QuadBackend::Immediate: FlushImmediate(width, height); break;
+        case QuadBackend::Instanced: FlushInstanced(width, height); break;
+    }
+
+    quads.clear();
+    keys.clear();
+}
+
+void QuadBatch::FlushCpu()
+{
+    // The tile renderer keeps pointers to the images until it renders
+    subImages.clear();
+    subImages.reserve(quads.size());
+
+    for (uint64_t key : keys)
+    {
+        const Quad& quad = quads[(uint32_t)key];
+        uint32_t texture = (uint32_t)(key >> 33 & 0x7FFF);
+        RasterRect rect = { (int32_t)lroundf(quad.x), (int32_t)lroundf(quad.y), (int32_t)lroundf(quad.width), (int32_t)lroundf(quad.height) };
+
+        if (texture != 0)
+        {
+            // Texture coordinates select a region; colors do not modulate textures here
+            const RasterImage& image = *textures[texture - 1].image;
+            int32_t x0 = SDL_max(0, (int32_t)(quad.u0 * image.width));
+            int32_t y0 = SDL_max(0, (int32_t)(quad.v0 * image.height));
+            int32_t x1 = SDL_min(image.width, (int32_t)ceilf(quad.u1 * image.width));
+            int32_t y1 = SDL_min(image.height, (int32_t)ceilf(quad.v1 * image.height));
+            if (x1 <= x0 || y1 <= y0) continue;
+
+            subImages.push_back({ image.pixels + (size_t)y0 * image.stride + x0, x1 - x0, y1 - y0, image.stride });
+            renderer->DrawImage(rect, &subImages.back());
+        }
+        else if (quad.left != quad.right)
+        {
+            renderer->FillGradient(rect, quad.left, quad.right);
+        }
+        else if ((quad.left >> 24) == 0xFF)
+        {
+            renderer->Fill(rect, quad.left);
+        }
+        else
+        {
+            renderer->Blend(rect, quad.left);
+        }
+    }
+}
+
+void QuadBatch::ApplyMaterial(uint32_t material)
+{
+    uint32_t texture = material >> 1;
+    state->BindTexture(GL_TEXTURE_2D, texture ? textures[texture - 1].name : whiteTexture);
+
+    if (material & 1)
+    {
+        state->Enable(GL_BLEND);
+        state->BlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    }
+    else
+    {
+        state->Disable(GL_BLEND);
+    }
+}
+
+void QuadBatch::FlushImmediate(int32_t width, int32_t height)
+{
+    state->PixelProjection(width, height);
+    state->Enable(GL_TEXTURE_2D);
+
+    // One glBegin per run of a material
+    size_t count = keys.size();
+    for (size_t start = 0; start < count; )
+    {
+        uint32_t material = (uint32_t)(keys[start] >> 32 & 0xFFFF);
+        ApplyMaterial(material);
+        glBegin(GL_QUADS);
+
+        size_t end = start;
+        for (; end < count && (uint32_t)(keys[end] >> 32 & 0xFFFF) == material; ++end)
+        {
+            const Quad& quad = quads[(uint32_t)keys[end]];
+            glColor4ub(quad.left >> 16 & 0xFF, quad.left >> 8 & 0xFF, quad.left & 0xFF, quad.left >> 24);
+            glTexCoord2f(quad.u0, quad.v0);
+            glVertex2f(quad.x, quad.y);
+            glTexCoord2f(quad.u0, quad.v1);
+            glVertex2f(quad.x, quad.y + quad.height);
+            glColor4ub(quad.right >> 16 & 0xFF, quad.right >> 8 & 0xFF, quad.right & 0xFF, quad.right >> 24);
+            glTexCoord2f(quad.u1, quad.v1);
+            glVertex2f(quad.x + quad.width, quad.y + quad.height);
+            glTexCoord2f(quad.u1, quad.v0);
+            glVertex2f(quad.x + quad.width, quad.y);
+        }
+
+        glEnd();
+        drawCalls++;
+        start = end;
+    }
+
+    state->Disable(GL_TEXTURE_2D);
+}
+
+size_t QuadBatch::Upload(const Quad* instances, uint32_t count)
+{
+    size_t regionSize = (size_t)QUAD_BATCH_CAPACITY * sizeof(Quad);
+
+    if (mapped == nullptr)
+    {
+        // Orphaning lets the driver hand out fresh storage while the GPU still reads the old one
+        glBufferData(GL_ARRAY_BUFFER, regionSize, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(Quad), instances);
+        return 0;
+    }
+
+    // Wait until the GPU is done with the draws that last read this region
+    region = (region + 1) % QUAD_BATCH_REGIONS;
+    if (fences[region])
+    {
+        glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        glDeleteSync(fences[region]);
+        fences[region] = nullptr;
+    }
+
+    memcpy(mapped + region * regionSize, instances, count * sizeof(Quad));
+    return region * regionSize;
+}
+
+void QuadBatch::FlushInstanced(int32_t width, int32_t height)
+{
+    // Gather in key order so every run is contiguous in the buffer
+    size_t count = keys.size();
+    ordered.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        ordered[i] = quads[(uint32_t)keys[i]];
+    }
+
+    state->UseProgram(program);
+    glBindVertexArray(vertexArray);
+    state->BindBuffer(GL_ARRAY_BUFFER, buffer);
+    glUniform2f(viewportLocation, (GLfloat)width, (GLfloat)height);
+
+    for (size_t chunk = 0; chunk < count; chunk += QUAD_BATCH_CAPACITY)
+    {
+        uint32_t chunkSize = (uint32_t)SDL_min(count - chunk, (size_t)QUAD_BATCH_CAPACITY);
+        size_t base = Upload(&ordered[chunk], chunkSize);
+
+        for (uint32_t start = 0; start < chunkSize; )
+        {
+            uint32_t material = (uint32_t)(keys[chunk + start] >> 32 & 0xFFFF);
+            uint32_t end = start + 1;
+            while (end < chunkSize && (uint32_t)(keys[chunk + end] >> 32 & 0xFFFF) == material) ++end;
+
+            // Point the attributes at the run instead of relying on base instances, which need OpenGL 4.2
+            size_t offset = base + start * sizeof(Quad);
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Quad), (const void*)(offset + offsetof(Quad, x)));
+            glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Quad), (const void*)(offset + offsetof(Quad, u0)));
+            glVertexAttribPointer(2, GL_BGRA, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Quad), (const void*)(offset + offsetof(Quad, left)));
+            glVertexAttribPointer(3, GL_BGRA, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Quad), (const void*)(offset + offsetof(Quad, right)));
+
+            ApplyMaterial(material);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, end - start);
+            drawCalls++;
+            start = end;
+        }
+
+        if (mapped) fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    glBindVertexArray(0);
+}
+
+void QuadBatch::ResetCounters()
+{
+    drawCalls = 0;
+    quadCount = 0;
+}
+
+void BenchmarkQuadBatch(GlState& state, int32_t width, int32_t height)
+{
+    const uint32_t frames = 5;
+    const uint32_t counts[] = { 10000, 100000, 1000000 };
+
+    // Translucent premultiplied texture; quads use one of its four quadrants
+    std::vector<uint32_t> texels(64 * 64);
+    for (uint32_t i = 0; i < texels.size(); ++i)
+    {
+        uint32_t a = 128 + (i & 127);
+        texels[i] = a << 24 | ((i * 7 & 0xFF) * a / 255) << 16 | ((i * 13 & 0xFF) * a / 255) << 8 | ((i >> 6) * 4 * a / 255);
+    }
+    RasterImage texture = { texels.data(), 64, 64, 64 };
+
+    std::vector<uint32_t> pixels((size_t)width * height);
+    RasterImage image = { pixels.data(), width, height, width };
+    TileRenderer renderer(0);
+
+    SDL_Log("Quad batch at %dx%d with %s", width, height, (const char*)glGetString(GL_RENDERER));
+
+    const QuadBackend backends[] = { QuadBackend::Instanced, QuadBackend::Immediate, QuadBackend::Cpu };
+    for (QuadBackend limit : backends)
+    {
+        QuadBatch batch;
+        QuadBackend backend = batch.Initialize(&state, &renderer, limit);
+        if (backend != limit) continue;
+
+        uint32_t id = batch.AddTexture(&texture);
+
+        for (uint32_t count : counts)
+        {
+            Uint64 elapsed = 0;
+            batch.ResetCounters();
+
+            for (uint32_t frame = 0; frame < frames + 1; ++frame)
+            {
+                // Same pseudo-random markers every frame, a quarter textured and a quarter translucent
+                uint32_t seed = 12345;
+                auto next = [&seed](uint32_t range) { seed = seed * 1664525 + 1013904223; return (seed >> 8) % range; };
+
+                Uint64 start = SDL_GetPerformanceCounter();
+
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    float size = (float)(4 + next(16));
+                    float u = (float)next(2) * 0.5f;
+                    float v = (float)next(2) * 0.5f;
+                    uint32_t color = 0xFF000000 | next(0xFFFFFF);
+                    if (i % 4 == 1) color = 0x80000000 | (color & 0x7F7F7F);
+
+                    Quad quad = { (float)next(width), (float)next(height), size, size, u, v, u + 0.5f, v + 0.5f, color, color };
+                    batch.Add(quad, i % 4 == 3 ? id : 0);
+                }
+
+                batch.Flush(width, height);
+
+                if (backend == QuadBackend::Cpu)
+                {
+                    renderer.Render(image);
+                }
+                else
+                {
+                    glFinish();
+                }
+
+                // The first frame warms up caches and the driver
+                if (frame > 0) elapsed += SDL_GetPerformanceCounter() - start;
+                else batch.ResetCounters();
+            }
+
+            double ms = (double)elapsed * 1000.0 / (double)SDL_GetPerformanceFrequency() / frames;
+            SDL_Log("%-24s %8u quads %6.1f draw calls %8.2f ms/frame %7.1f M quads/s", batch.BackendName(), count,
+                    batch.DrawCalls() / (double)frames, ms, count / ms / 1000.0);
+        }
+
+        if (backend != QuadBackend::Cpu) batch.Release();
+    }
+}
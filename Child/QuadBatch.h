@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <SDL.h>
+#include <SDL_opengl.h>
+
+#include "Raster.h"
+
+class GlState;
+class ProgramCache;
+class TileRenderer;
+
+
+// Collects 2D quads for a frame and submits them in as few draw calls as possible. Quads are sorted
+// by layer, then by material (texture and whether they blend); within a layer quads must not depend
+// on each other's order. With OpenGL 3.3 every run of one material is a single instanced draw fed
+// from a persistently mapped ring of vertex buffers, or orphaned buffers before OpenGL 4.4. Older GL
+// draws the runs in immediate mode, and the CPU backend hands the quads to the tile renderer, where
+// textured quads ignore their colors.
+#define QUAD_BATCH_CAPACITY     65536   // instances per region of the vertex buffer ring
+#define QUAD_BATCH_REGIONS      3       // regions the GPU may still read while the next one is written
+#define QUAD_BATCH_MAX_LAYERS   65536
+#define QUAD_BATCH_MAX_TEXTURES 32767
+#define QUAD_BATCH_PROGRAM      "quad"  // name of the instanced program in the program cache
+
+enum class QuadBackend
+{
+    Cpu,
+    Immediate,
+    Instanced
+};
+
+// One instance as the vertex shader reads it
+struct Quad
+{
+    float x;            // framebuffer pixels, bottom-up
+    float y;
+    float width;
+    float height;
+    float u0;           // texture coordinates at the bottom left and top right corner
+    float v0;
+    float u1;
+    float v1;
+    uint32_t left;      // premultiplied BGRA at the left edge
+    uint32_t right;     // and at the right edge; equal for flat quads
+};
+
+class QuadBatch
+{
+public:
+    QuadBatch();
+    ~QuadBatch();
+
+    // Uses GL when state is given, with the context current, otherwise renderer; returns the backend in use,
+    // the best one up to limit. The instanced program comes from programs when given, else it is compiled.
+    // Release frees the GL objects and must run while the context is still current.
+    QuadBackend Initialize(GlState* state, TileRenderer* renderer, QuadBackend limit = QuadBackend::Instanced,
+                           ProgramCache* programs = nullptr);
+    void Release();
+
+    QuadBackend Backend() const { return backend; }
+    const char* BackendName() const;
+
+    // Registers a premultiplied BGRA image, which must outlive the batch; returns its texture id, 0 when full
+    uint32_t AddTexture(const RasterImage* image);
+
+    // Sends area of a registered image to its texture again after the pixels changed
+    void UpdateTexture(uint32_t texture, RasterRect area);
+
+    // texture 0 draws flat or gradient colors
+    void Add(const Quad& quad, uint32_t texture, uint32_t layer = 0);
+    void Add(RasterRect rect, uint32_t color, uint32_t layer = 0);
+
+    // Draws everything added since the last flush into a framebuffer of width x height
+    void Flush(int32_t width, int32_t height);
+
+    // Totals since the last reset
+    uint64_t DrawCalls() const { return drawCalls; }
+    uint64_t Quads() const { return quadCount; }
+    void ResetCounters();
+
+private:
+    struct Texture
+    {
+        const RasterImage* image;
+        GLuint name;
+    };
+
+    bool InitializeInstanced(ProgramCache* programs);
+    void Sort();
+    void FlushCpu();
+    void FlushImmediate(int32_t width, int32_t height);
+    void FlushInstanced(int32_t width, int32_t height);
+    void ApplyMaterial(uint32_t material);
+    size_t Upload(const Quad* instances, uint32_t count);
+
+    QuadBackend backend;
+    GlState* state;
+    TileRenderer* renderer;
+
+    std::vector<Quad> quads;
+    std::vector<uint64_t> keys;         // layer, material and quad index, sorted at flush
+    std::vector<uint64_t> sortBuffer;
+    std::vector<uint32_t> histogram;
+    std::vector<Quad> ordered;          // quads in key order, as uploaded
+    std::vector<Texture> textures;      // id - 1
+    std::vector<RasterImage> subImages; // texture regions handed to the tile renderer
+
+    // instanced backend
+    GLuint program;
+    GLuint vertexArray;
+    GLuint buffer;
+    GLint viewportLocation;
+    uint8_t* mapped;                    // whole ring when persistently mapped, else nullptr
+    GLsync fences[QUAD_BATCH_REGIONS];
+    uint32_t region;
+
+    uint64_t drawCalls;
+    uint64_t quadCount;
+};
+
+// Draws 10k, 100k and 1M quads with every available backend and logs draw calls and frame times.
+// Needs a current context rendering into a width x height framebuffer.
+void BenchmarkQuadBatch(GlState& state, int32_t width, int32_t height);
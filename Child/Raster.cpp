@@ -0,0 +1,217 @@
+#include "Raster.h"
+
+#include <string.h>
+#include <vector>
+
+#include <SDL.h>
+
+static const RasterKernels* kernels = &ScalarRasterKernels;
+
+static void FillScalar(uint32_t* dst, int32_t count, uint32_t color)
+{
+    for (int32_t i = 0; i < count; ++i)
+    {
+        dst[i] = color;
+    }
+}
+
+static void GradientScalar(uint32_t* dst, int32_t count, uint32_t left, uint32_t right, uint32_t t, uint32_t dt)
+{
+    for (int32_t i = 0; i < count; ++i, t += dt)
+    {
+        dst[i] = RasterLerp(left, right, t >> 16);
+    }
+}
+
+static void BlendScalar(uint32_t* dst, int32_t count, uint32_t color)
+{
+    for (int32_t i = 0; i < count; ++i)
+    {
+        dst[i] = RasterOver(color, dst[i]);
+    }
+}
+
+static void BlendSampledScalar(uint32_t* dst, int32_t count, const uint32_t* src, uint32_t u, uint32_t du)
+{
+    for (int32_t i = 0; i < count; ++i, u += du)
+    {
+        dst[i] = RasterOver(src[u >> 16], dst[i]);
+    }
+}
+
+const RasterKernels ScalarRasterKernels = { "scalar", FillScalar, GradientScalar, BlendScalar, BlendSampledScalar };
+
+const RasterKernels* SelectRasterKernels()
+{
+    if (SDL_HasAVX2()) kernels = &Avx2RasterKernels;
+    else if (SDL_HasSSE2()) kernels = &Sse2RasterKernels;
+    else kernels = &ScalarRasterKernels;
+
+    return kernels;
+}
+
+void SetRasterKernels(const RasterKernels* table)
+{
+    kernels = table;
+}
+
+// Clips rect to the image; returns false when nothing is left. dx and dy receive how much was cut off the left and top.
+static bool ClipRect(const RasterImage& image, RasterRect& rect, int32_t& dx, int32_t& dy)
+{
+    int32_t left = SDL_max(rect.x, 0);
+    int32_t top = SDL_max(rect.y, 0);
+    int32_t right = SDL_min(rect.x + rect.width, image.width);
+    int32_t bottom = SDL_min(rect.y + rect.height, image.height);
+
+    dx = left - rect.x;
+    dy = top - rect.y;
+    rect = { left, top, right - left, bottom - top };
+    return rect.width > 0 && rect.height > 0;
+}
+
+void RasterClear(const RasterImage& image, uint32_t color)
+{
+    if (image.stride == image.width)
+    {
+        kernels->fill(image.pixels, image.width * image.height, color);
+        return;
+    }
+
+    RasterFillRect(image, { 0, 0, image.width, image.height }, color);
+}
+
+void RasterFillRect(const RasterImage& image, RasterRect rect, uint32_t color)
+{
+    int32_t dx, dy;
+    if (!ClipRect(image, rect, dx, dy)) return;
+
+    for (int32_t y = rect.y; y < rect.y + rect.height; ++y)
+    {
+        kernels->fill(image.pixels + (size_t)y * image.stride + rect.x, rect.width, color);
+    }
+}
+
+void RasterFillGradient(const RasterImage& image, RasterRect rect, uint32_t left, uint32_t right)
+{
+    // Weight runs from 0 at the first column to 256 at the last, in 16.16 fixed point
+    uint32_t dt = rect.width > 1 ? (256u << 16) / (uint32_t)(rect.width - 1) : 0;
+
+    int32_t dx, dy;
+    if (!ClipRect(image, rect, dx, dy)) return;
+
+    for (int32_t y = rect.y; y < rect.y + rect.height; ++y)
+    {
+        kernels->gradient(image.pixels + (size_t)y * image.stride + rect.x, rect.width, left, right, dx * dt, dt);
+    }
+}
+
+void RasterBlendRect(const RasterImage& image, RasterRect rect, uint32_t color)
+{
+    int32_t dx, dy;
+    if (!ClipRect(image, rect, dx, dy)) return;
+
+    // Opaque colors need no blending
+    if ((color >> 24) == 255)
+    {
+        RasterFillRect(image, rect, color);
+        return;
+    }
+
+    for (int32_t y = rect.y; y < rect.y + rect.height; ++y)
+    {
+        kernels->blend(image.pixels + (size_t)y * image.stride + rect.x, rect.width, color);
+    }
+}
+
+void RasterDrawImage(const RasterImage& image, RasterRect rect, const RasterImage& texture)
+{
+    if (rect.width <= 0 || rect.height <= 0) return;
+
+    // Sample texel centers in 16.16 fixed point
+    uint32_t du = ((uint32_t)texture.width << 16) / (uint32_t)rect.width;
+    uint32_t dv = ((uint32_t)texture.height << 16) / (uint32_t)rect.height;
+
+    int32_t dx, dy;
+    if (!ClipRect(image, rect, dx, dy)) return;
+
+    uint32_t u = dx * du + du / 2;
+    uint32_t v = dy * dv + dv / 2;
+
+    for (int32_t y = rect.y; y < rect.y + rect.height; ++y, v += dv)
+    {
+        const uint32_t* src = texture.pixels + (size_t)(v >> 16) * texture.stride;
+        kernels->blendSampled(image.pixels + (size_t)y * image.stride + rect.x, rect.width, src, u, du);
+    }
+}
+
+void BenchmarkRasterKernels(int32_t width, int32_t height)
+{
+    const RasterKernels* tables[3] = { &ScalarRasterKernels, nullptr, nullptr };
+    size_t tableCount = 1;
+    if (SDL_HasSSE2()) tables[tableCount++] = &Sse2RasterKernels;
+    if (SDL_HasAVX2()) tables[tableCount++] = &Avx2RasterKernels;
+
+    // Translucent premultiplied texture with a bit of everything in it
+    std::vector<uint32_t> texels(256 * 256);
+    uint32_t seed = 1;
+    for (uint32_t& texel : texels)
+    {
+        seed = seed * 1664525 + 1013904223;
+        uint32_t a = seed >> 24;
+        texel = a << 24 | (((seed >> 16) & 0xFF) * a / 255) << 16 | (((seed >> 8) & 0xFF) * a / 255) << 8 | ((seed & 0xFF) * a / 255);
+    }
+    RasterImage texture = { texels.data(), 256, 256, 256 };
+
+    std::vector<uint32_t> pixels((size_t)width * height);
+    std::vector<uint32_t> reference((size_t)width * height);
+    RasterImage image = { pixels.data(), width, height, width };
+    RasterRect rect = { 0, 0, width, height };
+
+    const char* names[5] = { "clear", "gradient", "blend", "textured quad", "mixed scene" };
+    uint32_t repeats = (uint32_t)SDL_max(1, 256 * 1024 * 1024 / ((long long)width * height));
+
+    auto draw = [&](int op)
+    {
+        switch (op)
+        {
+            case 0: RasterClear(image, 0xFF336619); break;
+            case 1: RasterFillGradient(image, rect, 0xFF0000FF, 0xFFFF8000); break;
+            case 2: RasterBlendRect(image, rect, 0x80402010); break;
+            case 3: RasterDrawImage(image, rect, texture); break;
+            case 4:
+                RasterFillGradient(image, rect, 0xFF203040, 0xFF405060);
+                RasterBlendRect(image, { width / 8, height / 8, width / 2, height / 2 }, 0x60300000);
+                RasterDrawImage(image, { width / 4, height / 4, width / 2, height / 2 }, texture);
+                break;
+        }
+    };
+
+    SDL_Log("Raster kernels at %dx%d, %u repeats", width, height, repeats);
+
+    for (int op = 0; op < 5; ++op)
+    {
+        for (size_t k = 0; k < tableCount; ++k)
+        {
+            SetRasterKernels(tables[k]);
+
+            // Same starting pixels for every table so results can be compared
+            RasterFillGradient(image, rect, 0xFF102030, 0xFF80C0F0);
+            draw(op);
+
+            if (k == 0) reference = pixels;
+            bool matches = memcmp(reference.data(), pixels.data(), pixels.size() * sizeof(uint32_t)) == 0;
+
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (uint32_t i = 0; i < repeats; ++i)
+            {
+                draw(op);
+            }
+            double seconds = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+
+            SDL_Log("%-14s %-7s %9.1f Mpixels/s%s", names[op], tables[k]->name,
+                    (double)width * height * repeats / seconds / 1000000.0, matches ? "" : "  MISMATCH");
+        }
+    }
+
+    SelectRasterKernels();
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stdint.h>
+
+
+// CPU rendering into 32-bit premultiplied BGRA images, the pixel format of the shared framebuffer.
+// Shapes are clipped here and drawn row by row through a table of span kernels. The scalar, SSE2
+// and AVX2 tables use the same fixed-point arithmetic, so they produce identical pixels; the
+// fastest one supported by the CPU is selected at startup.
+struct RasterImage
+{
+    uint32_t* pixels;
+    int32_t width;
+    int32_t height;
+    int32_t stride;     // pixels from one row to the next
+};
+
+struct RasterRect
+{
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+struct RasterKernels
+{
+    const char* name;
+
+    // dst[i] = color
+    void (*fill)(uint32_t* dst, int32_t count, uint32_t color);
+
+    // dst[i] = lerp(left, right, w) with weight w = ((t + i * dt) >> 16) in [0, 256]
+    void (*gradient)(uint32_t* dst, int32_t count, uint32_t left, uint32_t right, uint32_t t, uint32_t dt);
+
+    // dst[i] = color over dst[i]
+    void (*blend)(uint32_t* dst, int32_t count, uint32_t color);
+
+    // dst[i] = src[(u + i * du) >> 16] over dst[i]
+    void (*blendSampled)(uint32_t* dst, int32_t count, const uint32_t* src, uint32_t u, uint32_t du);
+};
+
+extern const RasterKernels ScalarRasterKernels;
+extern const RasterKernels Sse2RasterKernels;
+extern const RasterKernels Avx2RasterKernels;
+
+// Picks the fastest kernels this CPU supports and makes them current
+const RasterKernels* SelectRasterKernels();
+void SetRasterKernels(const RasterKernels* kernels);
+
+void RasterClear(const RasterImage& image, uint32_t color);
+void RasterFillRect(const RasterImage& image, RasterRect rect, uint32_t color);
+void RasterFillGradient(const RasterImage& image, RasterRect rect, uint32_t left, uint32_t right);
+void RasterBlendRect(const RasterImage& image, RasterRect rect, uint32_t color);
+
+// Textured quad, nearest sampled and blended over the image
+void RasterDrawImage(const RasterImage& image, RasterRect rect, const RasterImage& texture);
+
+// Times every kernel of every supported table on a width x height image and checks them against scalar
+void BenchmarkRasterKernels(int32_t width, int32_t height);
+
+inline uint32_t RasterColor(float red, float green, float blue, float alpha)
+{
+    // Premultiplied BGRA
+    uint32_t a = (uint32_t)(alpha * 255.0f + 0.5f);
+    uint32_t r = (uint32_t)(red * alpha * 255.0f + 0.5f);
+    uint32_t g = (uint32_t)(green * alpha * 255.0f + 0.5f);
+    uint32_t b = (uint32_t)(blue * alpha * 255.0f + 0.5f);
+    return a << 24 | r << 16 | g << 8 | b;
+}
+
+inline bool RasterEmpty(const RasterRect& rect)
+{
+    return rect.width <= 0 || rect.height <= 0;
+}
+
+inline RasterRect RasterIntersect(const RasterRect& a, const RasterRect& b)
+{
+    int32_t left = a.x > b.x ? a.x : b.x;
+    int32_t top = a.y > b.y ? a.y : b.y;
+    int32_t right = a.x + a.width < b.x + b.width ? a.x + a.width : b.x + b.width;
+    int32_t bottom = a.y + a.height < b.y + b.height ? a.y + a.height : b.y + b.height;
+
+    if (right <= left || bottom <= top) return { 0, 0, 0, 0 };
+    return { left, top, right - left, bottom - top };
+}
+
+// Bounding box of both; empty rects are ignored
+inline RasterRect RasterUnion(const RasterRect& a, const RasterRect& b)
+{
+    if (RasterEmpty(a)) return b;
+    if (RasterEmpty(b)) return a;
+
+    int32_t left = a.x < b.x ? a.x : b.x;
+    int32_t top = a.y < b.y ? a.y : b.y;
+    int32_t right = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+    int32_t bottom = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+    return { left, top, right - left, bottom - top };
+}
+
+// Per-pixel reference arithmetic shared by all kernels; SIMD kernels use it for their tails
+inline uint32_t RasterDiv255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+inline uint32_t RasterLerp(uint32_t left, uint32_t right, uint32_t weight)
+{
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        uint32_t l = (left >> shift) & 0xFF;
+        uint32_t r = (right >> shift) & 0xFF;
+        result |= ((l * (256 - weight) + r * weight) >> 8) << shift;
+    }
+    return result;
+}
+
+inline uint32_t RasterOver(uint32_t src, uint32_t dst)
+{
+    uint32_t inverse = 255 - (src >> 24);
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        uint32_t c = ((src >> shift) & 0xFF) + RasterDiv255(((dst >> shift) & 0xFF) * inverse);
+        result |= (c > 255 ? 255 : c) << shift;
+    }
+    return result;
+}
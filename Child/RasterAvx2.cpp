@@ -0,0 +1,114 @@
+#include "Raster.h"
+
+#include <immintrin.h>
+
+// Same arithmetic as RasterSse2.cpp on eight pixels. Unpacking works within 128-bit lanes, so the
+// low half holds pixels 0, 1, 4, 5 and the high half 2, 3, 6, 7; packing restores the order.
+static inline __m256i Div255(__m256i x)
+{
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+static inline __m256i Lerp(__m256i left, __m256i right, __m256i weight)
+{
+    __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(256), weight);
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(left, inverse), _mm256_mullo_epi16(right, weight)), 8);
+}
+
+static inline __m256i Over(__m256i src, __m256i dst)
+{
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, 0xFF), 0xFF);
+    return _mm256_add_epi16(src, Div255(_mm256_mullo_epi16(dst, _mm256_sub_epi16(_mm256_set1_epi16(255), alpha))));
+}
+
+static void FillAvx2(uint32_t* dst, int32_t count, uint32_t color)
+{
+    __m256i c = _mm256_set1_epi32((int)color);
+
+    int32_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_si256((__m256i*)(dst + i), c);
+    }
+
+    for (; i < count; ++i)
+    {
+        dst[i] = color;
+    }
+}
+
+static void GradientAvx2(uint32_t* dst, int32_t count, uint32_t left, uint32_t right, uint32_t t, uint32_t dt)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i l = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)left), zero);
+    __m256i r = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)right), zero);
+    __m256i weights = _mm256_add_epi32(_mm256_set1_epi32((int)t), _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int)dt)));
+    __m256i step = _mm256_set1_epi32((int)(8 * dt));
+
+    int32_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        // Repeat each pixel's weight across its four channels
+        __m256i w = _mm256_srli_epi32(weights, 16);
+        w = _mm256_packs_epi32(w, w);
+        w = _mm256_unpacklo_epi16(w, w);
+
+        __m256i lo = Lerp(l, r, _mm256_unpacklo_epi32(w, w));
+        __m256i hi = Lerp(l, r, _mm256_unpackhi_epi32(w, w));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+
+        weights = _mm256_add_epi32(weights, step);
+    }
+
+    for (t += i * dt; i < count; ++i, t += dt)
+    {
+        dst[i] = RasterLerp(left, right, t >> 16);
+    }
+}
+
+static void BlendAvx2(uint32_t* dst, int32_t count, uint32_t color)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i src = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)color), zero);
+
+    int32_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i lo = Over(src, _mm256_unpacklo_epi8(d, zero));
+        __m256i hi = Over(src, _mm256_unpackhi_epi8(d, zero));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    for (; i < count; ++i)
+    {
+        dst[i] = RasterOver(color, dst[i]);
+    }
+}
+
+static void BlendSampledAvx2(uint32_t* dst, int32_t count, const uint32_t* src, uint32_t u, uint32_t du)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i coordinates = _mm256_add_epi32(_mm256_set1_epi32((int)u), _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int)du)));
+    __m256i step = _mm256_set1_epi32((int)(8 * du));
+
+    int32_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i s = _mm256_i32gather_epi32((const int*)src, _mm256_srli_epi32(coordinates, 16), 4);
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i lo = Over(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+        __m256i hi = Over(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+
+        coordinates = _mm256_add_epi32(coordinates, step);
+    }
+
+    for (u += i * du; i < count; ++i, u += du)
+    {
+        dst[i] = RasterOver(src[u >> 16], dst[i]);
+    }
+}
+
+const RasterKernels Avx2RasterKernels = { "AVX2", FillAvx2, GradientAvx2, BlendAvx2, BlendSampledAvx2 };
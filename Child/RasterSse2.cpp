@@ -0,0 +1,111 @@
+#include "Raster.h"
+
+#include <emmintrin.h>
+
+// Pixels are widened to 16-bit channels, [B G R A B G R A] per register half, so products of two
+// 8-bit values and 256-based weights stay exact.
+static inline __m128i Div255(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+static inline __m128i Lerp(__m128i left, __m128i right, __m128i weight)
+{
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(256), weight);
+    return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(left, inverse), _mm_mullo_epi16(right, weight)), 8);
+}
+
+static inline __m128i Over(__m128i src, __m128i dst)
+{
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xFF), 0xFF);
+    return _mm_add_epi16(src, Div255(_mm_mullo_epi16(dst, _mm_sub_epi16(_mm_set1_epi16(255), alpha))));
+}
+
+static void FillSse2(uint32_t* dst, int32_t count, uint32_t color)
+{
+    __m128i c = _mm_set1_epi32((int)color);
+
+    int32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_si128((__m128i*)(dst + i), c);
+    }
+
+    for (; i < count; ++i)
+    {
+        dst[i] = color;
+    }
+}
+
+static void GradientSse2(uint32_t* dst, int32_t count, uint32_t left, uint32_t right, uint32_t t, uint32_t dt)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i l = _mm_unpacklo_epi8(_mm_set1_epi32((int)left), zero);
+    __m128i r = _mm_unpacklo_epi8(_mm_set1_epi32((int)right), zero);
+    __m128i weights = _mm_setr_epi32((int)t, (int)(t + dt), (int)(t + 2 * dt), (int)(t + 3 * dt));
+    __m128i step = _mm_set1_epi32((int)(4 * dt));
+
+    int32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        // Repeat each pixel's weight across its four channels
+        __m128i w = _mm_srli_epi32(weights, 16);
+        w = _mm_packs_epi32(w, w);
+        w = _mm_unpacklo_epi16(w, w);
+
+        __m128i lo = Lerp(l, r, _mm_unpacklo_epi32(w, w));
+        __m128i hi = Lerp(l, r, _mm_unpackhi_epi32(w, w));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+
+        weights = _mm_add_epi32(weights, step);
+    }
+
+    for (t += i * dt; i < count; ++i, t += dt)
+    {
+        dst[i] = RasterLerp(left, right, t >> 16);
+    }
+}
+
+static void BlendSse2(uint32_t* dst, int32_t count, uint32_t color)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i src = _mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero);
+
+    int32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i lo = Over(src, _mm_unpacklo_epi8(d, zero));
+        __m128i hi = Over(src, _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    for (; i < count; ++i)
+    {
+        dst[i] = RasterOver(color, dst[i]);
+    }
+}
+
+static void BlendSampledSse2(uint32_t* dst, int32_t count, const uint32_t* src, uint32_t u, uint32_t du)
+{
+    __m128i zero = _mm_setzero_si128();
+
+    int32_t i = 0;
+    for (; i + 4 <= count; i += 4, u += 4 * du)
+    {
+        // No gather before AVX2
+        __m128i s = _mm_setr_epi32((int)src[u >> 16], (int)src[(u + du) >> 16], (int)src[(u + 2 * du) >> 16], (int)src[(u + 3 * du) >> 16]);
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i lo = Over(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+        __m128i hi = Over(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    for (; i < count; ++i, u += du)
+    {
+        dst[i] = RasterOver(src[u >> 16], dst[i]);
+    }
+}
+
+const RasterKernels Sse2RasterKernels = { "SSE2", FillSse2, GradientSse2, BlendSse2, BlendSampledSse2 };
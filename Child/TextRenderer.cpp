@@ -0,0 +1,371 @@
+#include "TextRenderer.h"
+
+#include <string.h>
+
+#include <SDL.h>
+
+#include "QuadBatch.h"
+#include "TileRenderer.h"
+
+// Marks a cell key as occupied, so glyph 0 in color 0 is not mistaken for an empty cell
+#define TEXT_CELL_USED  0x10000ull
+#define TEXT_NO_CELL    0xFFFFFFFF
+
+TextRenderer::TextRenderer()
+    : batch(nullptr), dc(NULL), font(NULL), previousFont(NULL), lineHeight(0), atlas(), atlasTexture(0), dirty(),
+      cellSize(0), columns(0), newest(TEXT_NO_CELL), oldest(TEXT_NO_CELL), frame(1), runSweep(0), stats()
+{
+}
+
+TextRenderer::~TextRenderer()
+{
+    if (dc)
+    {
+        if (previousFont) SelectObject(dc, previousFont);
+        DeleteDC(dc);
+    }
+    if (font) DeleteObject(font);
+}
+
+bool TextRenderer::Initialize(QuadBatch* quadBatch, const wchar_t* face, int32_t pixelHeight)
+{
+    batch = quadBatch;
+
+    // Glyphs are only measured and rasterized, so a memory DC with no bitmap selected is enough
+    dc = CreateCompatibleDC(NULL);
+    font = CreateFontW(-pixelHeight, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_TT_PRECIS,
+                       CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, DEFAULT_PITCH | FF_DONTCARE, face);
+
+    TEXTMETRIC metrics;
+    if (dc == NULL || font == NULL || (previousFont = SelectObject(dc, font)) == NULL || !GetTextMetricsW(dc, &metrics))
+    {
+        SDL_Log("Unable to create a %d pixel font for text", pixelHeight);
+        return false;
+    }
+
+    lineHeight = metrics.tmHeight + metrics.tmExternalLeading;
+
+    // Square cells fit the widest and the tallest glyph; larger ones are cut off
+    cellSize = SDL_max(metrics.tmHeight, metrics.tmMaxCharWidth) + TEXT_CELL_PADDING;
+    columns = TEXT_ATLAS_SIZE / cellSize;
+    if (columns == 0)
+    {
+        SDL_Log("A %d pixel font does not fit the text atlas", pixelHeight);
+        return false;
+    }
+
+    atlasPixels.assign((size_t)TEXT_ATLAS_SIZE * TEXT_ATLAS_SIZE, 0);
+    atlas = { atlasPixels.data(), TEXT_ATLAS_SIZE, TEXT_ATLAS_SIZE, TEXT_ATLAS_SIZE };
+    atlasTexture = batch->AddTexture(&atlas);
+    if (atlasTexture == 0)
+    {
+        SDL_Log("No texture left for the text atlas");
+        return false;
+    }
+
+    // Every cell starts out empty in the list, the first ones oldest
+    uint32_t cellCount = (uint32_t)(columns * columns);
+    cells.assign(cellCount, Cell());
+    for (uint32_t i = 0; i < cellCount; ++i)
+    {
+        PushNewest(i);
+    }
+
+    blank.assign(65536, 0);
+    runs.reserve(TEXT_RUN_CACHE_SIZE);
+    return true;
+}
+
+void TextRenderer::BeginFrame()
+{
+    frame++;
+}
+
+void TextRenderer::Unlink(uint32_t index)
+{
+    Cell& cell = cells[index];
+    if (cell.newer != TEXT_NO_CELL) cells[cell.newer].older = cell.older;
+    else newest = cell.older;
+    if (cell.older != TEXT_NO_CELL) cells[cell.older].newer = cell.newer;
+    else oldest = cell.newer;
+}
+
+void TextRenderer::PushNewest(uint32_t index)
+{
+    Cell& cell = cells[index];
+    cell.newer = TEXT_NO_CELL;
+    cell.older = newest;
+    if (newest != TEXT_NO_CELL) cells[newest].newer = index;
+    else oldest = index;
+    newest = index;
+}
+
+const TextRenderer::Run* TextRenderer::Shape(const char* utf8)
+{
+    runKey.assign(utf8);
+    auto found = runs.find(runKey);
+    if (found != runs.end())
+    {
+        stats.runHits++;
+        found->second.frame = frame;
+        return &found->second;
+    }
+
+    stats.runMisses++;
+
+    // Keep the strings of this frame; the rest are laid out again when they come back. One sweep per frame
+    // at most: when this frame alone draws more strings than the cache holds, the map grows until the next one.
+    if (runs.size() >= TEXT_RUN_CACHE_SIZE && runSweep != frame)
+    {
+        runSweep = frame;
+        for (auto run = runs.begin(); run != runs.end(); )
+        {
+            if (run->second.frame != frame) run = runs.erase(run);
+            else ++run;
+        }
+    }
+
+    Run& run = runs[runKey];
+    run.frame = frame;
+    run.width = 0;
+
+    int length = MultiByteToWideChar(CP_UTF8, 0, utf8, (int)runKey.size(), nullptr, 0);
+    if (length <= 0) return &run;
+
+    wide.resize(length);
+    MultiByteToWideChar(CP_UTF8, 0, utf8, (int)runKey.size(), wide.data(), length);
+
+    // Glyph indices with ligatures and kerning applied, one advance per glyph
+    run.glyphs.resize(length);
+    run.advances.resize(length);
+
+    GCP_RESULTSW results = {};
+    results.lStructSize = sizeof(results);
+    results.lpGlyphs = run.glyphs.data();
+    results.lpDx = (int*)run.advances.data();
+    results.nGlyphs = (UINT)length;
+
+    if (GetCharacterPlacementW(dc, wide.data(), length, 0, &results, GCP_LIGATE | GCP_USEKERNING) == 0)
+    {
+        run.glyphs.clear();
+        run.advances.clear();
+        return &run;
+    }
+
+    run.glyphs.resize(results.nGlyphs);
+    run.advances.resize(results.nGlyphs);
+    for (int32_t advance : run.advances)
+    {
+        run.width += advance;
+    }
+    return &run;
+}
+
+bool TextRenderer::Rasterize(Cell& cell, uint32_t index, WCHAR glyph, uint32_t color)
+{
+    static const MAT2 identity = { { 0, 1 }, { 0, 0 }, { 0, 0 }, { 0, 1 } };
+
+    GLYPHMETRICS metrics;
+    DWORD size = GetGlyphOutlineW(dc, glyph, GGO_GRAY8_BITMAP | GGO_GLYPH_INDEX, &metrics, 0, nullptr, &identity);
+    if (size == GDI_ERROR || size == 0) return false;
+
+    coverage.resize(size);
+    if (GetGlyphOutlineW(dc, glyph, GGO_GRAY8_BITMAP | GGO_GLYPH_INDEX, &metrics, size, coverage.data(), &identity) == GDI_ERROR)
+    {
+        return false;
+    }
+
+    int32_t cellX = (int32_t)(index % columns) * cellSize;
+    int32_t cellY = (int32_t)(index / columns) * cellSize;
+    int32_t inside = cellSize - TEXT_CELL_PADDING;
+
+    cell.width = SDL_min((int32_t)metrics.gmBlackBoxX, inside);
+    cell.height = SDL_min((int32_t)metrics.gmBlackBoxY, inside);
+    cell.x = metrics.gmptGlyphOrigin.x;
+    cell.y = metrics.gmptGlyphOrigin.y - (int32_t)metrics.gmBlackBoxY;
+
+    // 65 levels of coverage in DWORD aligned rows, top-down; the atlas is bottom-up like the framebuffer
+    uint32_t pitch = (metrics.gmBlackBoxX + 3) & ~3u;
+    for (int32_t y = 0; y < inside; ++y)
+    {
+        uint32_t* dst = atlas.pixels + (size_t)(cellY + y) * atlas.stride + cellX;
+        int32_t row = (int32_t)metrics.gmBlackBoxY - 1 - y;
+
+        for (int32_t x = 0; x < inside; ++x)
+        {
+            uint32_t level = 0;
+            if (x < cell.width && y < cell.height) level = SDL_min((uint32_t)coverage[(size_t)row * pitch + x], 64u);
+
+            // Premultiplied color scaled by coverage
+            dst[x] = ((color >> 24) * level / 64) << 24 | ((color >> 16 & 0xFF) * level / 64) << 16 |
+                     ((color >> 8 & 0xFF) * level / 64) << 8 | (color & 0xFF) * level / 64;
+        }
+    }
+
+    // Grow the region the next upload sends
+    RasterRect area = { cellX, cellY, inside, inside };
+    dirty = RasterUnion(dirty, area);
+    return true;
+}
+
+const TextRenderer::Cell* TextRenderer::Glyph(WCHAR glyph, uint32_t color)
+{
+    if (blank[(uint16_t)glyph]) return nullptr;
+
+    uint64_t key = (uint64_t)color << 32 | TEXT_CELL_USED | (uint16_t)glyph;
+    auto found = cellIndex.find(key);
+    if (found != cellIndex.end())
+    {
+        stats.glyphHits++;
+        uint32_t index = found->second;
+        cells[index].frame = frame;
+        Unlink(index);
+        PushNewest(index);
+        return &cells[index];
+    }
+
+    stats.glyphMisses++;
+
+    // Everything drawn this frame is newer than the oldest cell, so it is either free or still needed
+    uint32_t index = oldest;
+    Cell& cell = cells[index];
+    if (cell.frame == frame)
+    {
+        stats.dropped++;
+        return nullptr;
+    }
+
+    if (cell.key != 0)
+    {
+        cellIndex.erase(cell.key);
+        cell.key = 0;
+        stats.evictions++;
+    }
+
+    // No pixels in any color; the cell stays free
+    if (!Rasterize(cell, index, glyph, color))
+    {
+        blank[(uint16_t)glyph] = 1;
+        return nullptr;
+    }
+
+    Unlink(index);
+    PushNewest(index);
+    cell.key = key;
+    cell.frame = frame;
+    cellIndex[key] = index;
+    return &cell;
+}
+
+int32_t TextRenderer::Draw(const char* utf8, int32_t x, int32_t y, uint32_t color, uint32_t layer)
+{
+    if (batch == nullptr || cells.empty()) return 0;
+
+    const Run* run = Shape(utf8);
+    int32_t pen = x;
+    float scale = 1.0f / TEXT_ATLAS_SIZE;
+
+    for (size_t i = 0; i < run->glyphs.size(); ++i)
+    {
+        const Cell* cell = Glyph(run->glyphs[i], color);
+        if (cell)
+        {
+            uint32_t index = (uint32_t)(cell - cells.data());
+            float u = (float)((int32_t)(index % columns) * cellSize) * scale;
+            float v = (float)((int32_t)(index / columns) * cellSize) * scale;
+
+            // The color is in the texels already
+            Quad quad = { (float)(pen + cell->x), (float)(y + cell->y), (float)cell->width, (float)cell->height,
+                          u, v, u + cell->width * scale, v + cell->height * scale, 0xFFFFFFFF, 0xFFFFFFFF };
+            batch->Add(quad, atlasTexture, layer);
+        }
+        pen += run->advances[i];
+    }
+    return pen - x;
+}
+
+void TextRenderer::Upload()
+{
+    if (RasterEmpty(dirty)) return;
+
+    batch->UpdateTexture(atlasTexture, dirty);
+    dirty = RasterRect();
+}
+
+void TextRenderer::ResetStats()
+{
+    stats = TextStats();
+}
+
+void BenchmarkTextRenderer(int32_t width, int32_t height)
+{
+    const uint32_t labels = 10000;
+    const uint32_t frames = 60;
+    const uint32_t colors[] = { 0xFFFFFFFF, 0xFF40C0FF, 0xFFFFC040, 0xC0C0C0C0 };
+
+    std::vector<uint32_t> pixels((size_t)width * height);
+    RasterImage image = { pixels.data(), width, height, width };
+    TileRenderer renderer(0);
+
+    SDL_Log("Text at %dx%d, %u labels per frame", width, height, labels);
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        bool changing = pass == 1;
+
+        // Fresh caches, so both passes start cold
+        QuadBatch batch;
+        batch.Initialize(nullptr, &renderer);
+        TextRenderer text;
+        if (!text.Initialize(&batch, L"Segoe UI", 14)) return;
+
+        int32_t columns = SDL_max(1, width / 96);
+        uint32_t rows = (uint32_t)SDL_max(1, height / text.LineHeight());
+        Uint64 layoutTime = 0;
+        Uint64 renderTime = 0;
+        char label[64];
+
+        for (uint32_t frame = 0; frame < frames + 1; ++frame)
+        {
+            Uint64 start = SDL_GetPerformanceCounter();
+            text.BeginFrame();
+
+            for (uint32_t i = 0; i < labels; ++i)
+            {
+                // Changing labels read like counters, so their glyphs stay cached while their strings do not
+                if (changing) SDL_snprintf(label, sizeof(label), "Item %u: %u", i, frame * 7919 + i);
+                else SDL_snprintf(label, sizeof(label), "Item %u", i);
+
+                int32_t x = (int32_t)(i % columns) * 96;
+                int32_t y = height - (int32_t)(i / columns % rows + 1) * text.LineHeight();
+                text.Draw(label, x, y, colors[i % 4]);
+            }
+
+            text.Upload();
+            Uint64 laidOut = SDL_GetPerformanceCounter();
+
+            batch.Flush(width, height);
+            renderer.Render(image);
+            Uint64 end = SDL_GetPerformanceCounter();
+
+            // The first frame fills the caches
+            if (frame > 0)
+            {
+                layoutTime += laidOut - start;
+                renderTime += end - laidOut;
+            }
+            else
+            {
+                text.ResetStats();
+            }
+        }
+
+        const TextStats& stats = text.Stats();
+        double scale = 1000.0 / (double)SDL_GetPerformanceFrequency() / frames;
+        SDL_Log("%-8s labels: layout %7.3f ms/frame, render %7.3f ms/frame, runs %5.1f%% cached, glyphs %5.1f%% cached, "
+                "%llu evictions, %llu dropped", changing ? "changing" : "static", layoutTime * scale, renderTime * scale,
+                100.0 * stats.runHits / SDL_max(1ull, stats.runHits + stats.runMisses),
+                100.0 * stats.glyphHits / SDL_max(1ull, stats.glyphHits + stats.glyphMisses),
+                (unsigned long long)stats.evictions, (unsigned long long)stats.dropped);
+    }
+}
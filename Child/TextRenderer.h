@@ -0,0 +1,115 @@
+#pragma once
+
+#include <windows.h>
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Raster.h"
+
+class QuadBatch;
+
+
+// Draws UTF-8 labels through the quad batch. GDI shapes each distinct string once into glyph indices
+// and advances, which the run cache keeps so unchanged strings skip layout entirely. Glyphs are
+// rasterized once per color into fixed cells of an atlas texture; colors are baked in so the CPU
+// backend can draw them as plain images. Cells are reused least recently used first, but never while
+// the current frame still draws them: a glyph that finds no free cell is dropped for that frame.
+#define TEXT_ATLAS_SIZE         1024    // atlas width and height; a power of two keeps texture coordinates exact
+#define TEXT_CELL_PADDING       1       // empty pixels between cells so sampling never bleeds into a neighbour
+#define TEXT_RUN_CACHE_SIZE     16384   // shaped strings kept before those unused this frame are evicted, once per frame
+
+struct TextStats
+{
+    uint64_t runHits;       // strings drawn without layout
+    uint64_t runMisses;
+    uint64_t glyphHits;     // glyphs found in the atlas
+    uint64_t glyphMisses;
+    uint64_t evictions;     // cells reused for another glyph
+    uint64_t dropped;       // glyphs not drawn because every cell was in use this frame
+};
+
+class TextRenderer
+{
+public:
+    TextRenderer();
+    ~TextRenderer();
+
+    // Creates the font, pixelHeight tall from ascent to descent, and registers the atlas with batch
+    bool Initialize(QuadBatch* batch, const wchar_t* face, int32_t pixelHeight);
+
+    // Starts a frame; cells and runs used from here on are kept until the next call
+    void BeginFrame();
+
+    // Adds the quads of a string with its baseline at y, bottom-up; returns the advance in pixels
+    int32_t Draw(const char* utf8, int32_t x, int32_t y, uint32_t color, uint32_t layer = 0);
+
+    // Uploads the cells rasterized since the last call; run before flushing the batch
+    void Upload();
+
+    int32_t LineHeight() const { return lineHeight; }
+
+    const TextStats& Stats() const { return stats; }
+    void ResetStats();
+
+private:
+    // A string as GDI laid it out
+    struct Run
+    {
+        std::vector<WCHAR> glyphs;
+        std::vector<int32_t> advances;
+        int32_t width;
+        uint32_t frame;         // last frame that drew it
+    };
+
+    struct Cell
+    {
+        uint64_t key;           // color and glyph index; 0 while empty
+        int32_t x;              // bitmap offset from the pen position on the baseline
+        int32_t y;
+        int32_t width;
+        int32_t height;
+        uint32_t frame;         // last frame that drew it
+        uint32_t newer;         // neighbours in the least recently used list
+        uint32_t older;
+    };
+
+    const Run* Shape(const char* utf8);
+    const Cell* Glyph(WCHAR glyph, uint32_t color);
+    bool Rasterize(Cell& cell, uint32_t index, WCHAR glyph, uint32_t color);
+    void Unlink(uint32_t index);
+    void PushNewest(uint32_t index);
+
+    QuadBatch* batch;
+    HDC dc;
+    HFONT font;
+    HGDIOBJ previousFont;
+    int32_t lineHeight;
+
+    std::unordered_map<std::string, Run> runs;
+    std::string runKey;                     // reused so lookups do not allocate
+    std::vector<WCHAR> wide;
+    std::vector<uint8_t> coverage;          // GDI glyph bitmap
+
+    std::vector<uint32_t> atlasPixels;
+    RasterImage atlas;
+    uint32_t atlasTexture;
+    RasterRect dirty;                       // cells written since the last upload
+
+    std::vector<Cell> cells;
+    std::unordered_map<uint64_t, uint32_t> cellIndex;
+    std::vector<uint8_t> blank;             // glyph indices without pixels, such as spaces
+    int32_t cellSize;
+    int32_t columns;
+    uint32_t newest;
+    uint32_t oldest;
+
+    uint32_t frame;
+    uint32_t runSweep;                      // frame of the last sweep over runs
+    TextStats stats;
+};
+
+// Times 10k labels per frame that stay the same against 10k that change every frame and logs the cache hit rates
+void BenchmarkTextRenderer(int32_t width, int32_t height);
@@ -0,0 +1,434 @@
+#include "TextureManager.h"
+
+#include <string.h>
+
+#include "QuadBatch.h"
+#include "TileRenderer.h"
+
+void SkylinePacker::Reset(int32_t width, int32_t height)
+{
+    areaWidth = width;
+    areaHeight = height;
+    skyline.assign(1, Segment{ 0, 0, width });
+}
+
+int32_t SkylinePacker::Fit(size_t segment, int32_t width, int32_t height) const
+{
+    if (skyline[segment].x + width > areaWidth) return -1;
+
+    // Rest on the highest segment below the rectangle; segments cover the whole width, so this stays in range
+    int32_t y = 0;
+    for (size_t i = segment; width > 0; ++i)
+    {
+        y = SDL_max(y, skyline[i].y);
+        if (y + height > areaHeight) return -1;
+        width -= skyline[i].width;
+    }
+    return y;
+}
+
+bool SkylinePacker::Insert(int32_t width, int32_t height, int32_t& x, int32_t& y)
+{
+    size_t best = skyline.size();
+    int32_t bestY = areaHeight;
+    int32_t bestWidth = areaWidth + 1;
+
+    // Lowest position, then the narrowest segment, so wide gaps stay free for wide images
+    for (size_t i = 0; i < skyline.size(); ++i)
+    {
+        int32_t fit = Fit(i, width, height);
+        if (fit >= 0 && (fit < bestY || (fit == bestY && skyline[i].width < bestWidth)))
+        {
+            best = i;
+            bestY = fit;
+            bestWidth = skyline[i].width;
+        }
+    }
+    if (best == skyline.size()) return false;
+
+    x = skyline[best].x;
+    y = bestY;
+
+    // The top of the rectangle replaces the segments it covers
+    Segment top = { x, y + height, width };
+    skyline.insert(skyline.begin() + best, top);
+
+    for (size_t i = best + 1; i < skyline.size(); )
+    {
+        Segment& segment = skyline[i];
+        int32_t covered = top.x + top.width - segment.x;
+        if (covered <= 0) break;
+
+        if (covered < segment.width)
+        {
+            segment.x += covered;
+            segment.width -= covered;
+            break;
+        }
+        skyline.erase(skyline.begin() + i);
+    }
+
+    for (size_t i = 0; i + 1 < skyline.size(); )
+    {
+        if (skyline[i].y == skyline[i + 1].y)
+        {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    return true;
+}
+
+TextureManager::TextureManager()
+    : batch(nullptr), loader(nullptr), context(nullptr), maxPages(0), inFlight(0), frame(1), thread(nullptr),
+      mutex(nullptr), wake(nullptr), loadedBytes(0), stopping(false), stats()
+{
+}
+
+TextureManager::~TextureManager()
+{
+    if (thread)
+    {
+        SDL_LockMutex(mutex);
+        stopping = true;
+        SDL_UnlockMutex(mutex);
+        SDL_SemPost(wake);
+        SDL_WaitThread(thread, nullptr);
+    }
+
+    if (wake) SDL_DestroySemaphore(wake);
+    if (mutex) SDL_DestroyMutex(mutex);
+}
+
+bool TextureManager::Initialize(QuadBatch* quadBatch, size_t budget, TextureLoader textureLoader, void* loaderContext)
+{
+    batch = quadBatch;
+    loader = textureLoader;
+    context = loaderContext;
+
+    // At least one page, whatever the budget
+    size_t pageBytes = (size_t)TEXTURE_PAGE_SIZE * TEXTURE_PAGE_SIZE * sizeof(uint32_t);
+    maxPages = SDL_max((size_t)1, budget / pageBytes);
+    pages.reserve(maxPages);
+
+    mutex = SDL_CreateMutex();
+    wake = SDL_CreateSemaphore(0);
+    thread = mutex && wake ? SDL_CreateThread(LoaderMain, "Textures", this) : nullptr;
+
+    if (thread == nullptr)
+    {
+        SDL_Log("Unable to start the texture loader: %s", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+int TextureManager::LoaderMain(void* data)
+{
+    TextureManager* manager = (TextureManager*)data;
+
+    // One post per request, and one more to stop
+    for (;;)
+    {
+        SDL_SemWait(manager->wake);
+        SDL_LockMutex(manager->mutex);
+
+        if (manager->stopping)
+        {
+            SDL_UnlockMutex(manager->mutex);
+            return 0;
+        }
+
+        Request request = manager->requests.front();
+        manager->requests.pop_front();
+        SDL_UnlockMutex(manager->mutex);
+
+        Loaded loaded = { request.image, false };
+        loaded.pixels.resize((size_t)request.width * request.height);
+        manager->loadedBytes += loaded.pixels.size() * sizeof(uint32_t);
+
+        RasterImage target = { loaded.pixels.data(), request.width, request.height, request.width };
+        loaded.valid = manager->loader(manager->context, request.image, target);
+
+        SDL_LockMutex(manager->mutex);
+        manager->completed.push_back(std::move(loaded));
+        SDL_UnlockMutex(manager->mutex);
+    }
+}
+
+uint32_t TextureManager::Register(int32_t width, int32_t height)
+{
+    if (width <= 0 || height <= 0) return 0;
+    if (width + TEXTURE_PAGE_PADDING > TEXTURE_PAGE_SIZE || height + TEXTURE_PAGE_PADDING > TEXTURE_PAGE_SIZE) return 0;
+
+    images.push_back({ width, height, 0, 0, 0, Residency::Absent });
+    return (uint32_t)images.size();
+}
+
+void TextureManager::BeginFrame()
+{
+    frame++;
+
+    SDL_LockMutex(mutex);
+    placing.swap(completed);
+    SDL_UnlockMutex(mutex);
+
+    stats.peakBytes = SDL_max(stats.peakBytes, PageBytes() + loadedBytes);
+
+    for (Loaded& loaded : placing)
+    {
+        Place(loaded);
+        loadedBytes -= loaded.pixels.size() * sizeof(uint32_t);
+        inFlight--;
+    }
+    placing.clear();
+}
+
+TextureManager::Page* TextureManager::FindRoom(int32_t width, int32_t height, int32_t& x, int32_t& y)
+{
+    for (Page& page : pages)
+    {
+        if (page.packer.Insert(width, height, x, y)) return &page;
+    }
+
+    if (pages.size() < maxPages)
+    {
+        pages.emplace_back();
+        Page& page = pages.back();
+        page.pixels.assign((size_t)TEXTURE_PAGE_SIZE * TEXTURE_PAGE_SIZE, 0);
+        page.image = { page.pixels.data(), TEXTURE_PAGE_SIZE, TEXTURE_PAGE_SIZE, TEXTURE_PAGE_SIZE };
+        page.texture = batch->AddTexture(&page.image);
+        page.packer.Reset(TEXTURE_PAGE_SIZE, TEXTURE_PAGE_SIZE);
+        page.frame = 0;
+        page.dirty = RasterRect();
+
+        if (page.texture != 0)
+        {
+            stats.peakBytes = SDL_max(stats.peakBytes, PageBytes() + loadedBytes);
+            return page.packer.Insert(width, height, x, y) ? &page : nullptr;
+        }
+
+        // The batch has no texture left; make do with the pages there are
+        pages.pop_back();
+        maxPages = pages.size();
+    }
+
+    // Empty the least recently drawn page; the last frame is flushed already, but images placed for this one stay
+    Page* oldest = nullptr;
+    for (Page& page : pages)
+    {
+        if (page.frame < frame && (oldest == nullptr || page.frame < oldest->frame)) oldest = &page;
+    }
+    if (oldest == nullptr) return nullptr;
+
+    for (uint32_t image : oldest->images)
+    {
+        images[image - 1].residency = Residency::Absent;
+    }
+    oldest->images.clear();
+    oldest->packer.Reset(TEXTURE_PAGE_SIZE, TEXTURE_PAGE_SIZE);
+    stats.evictions++;
+
+    return oldest->packer.Insert(width, height, x, y) ? oldest : nullptr;
+}
+
+void TextureManager::Place(Loaded& loaded)
+{
+    Image& image = images[loaded.image - 1];
+    if (!loaded.valid)
+    {
+        image.residency = Residency::Failed;
+        return;
+    }
+
+    int32_t x, y;
+    Page* page = FindRoom(image.width + TEXTURE_PAGE_PADDING, image.height + TEXTURE_PAGE_PADDING, x, y);
+    if (page == nullptr)
+    {
+        // Requested again the next time it is drawn
+        image.residency = Residency::Absent;
+        stats.deferred++;
+        return;
+    }
+
+    // Clear the padding too, a reused page still holds the previous images
+    int32_t width = SDL_min(image.width + TEXTURE_PAGE_PADDING, TEXTURE_PAGE_SIZE - x);
+    int32_t height = SDL_min(image.height + TEXTURE_PAGE_PADDING, TEXTURE_PAGE_SIZE - y);
+
+    for (int32_t row = 0; row < height; ++row)
+    {
+        uint32_t* dst = page->image.pixels + (size_t)(y + row) * page->image.stride + x;
+        if (row < image.height)
+        {
+            memcpy(dst, &loaded.pixels[(size_t)row * image.width], image.width * sizeof(uint32_t));
+            if (width > image.width) dst[image.width] = 0;
+        }
+        else
+        {
+            memset(dst, 0, width * sizeof(uint32_t));
+        }
+    }
+
+    image.x = x;
+    image.y = y;
+    image.page = (uint32_t)(page - pages.data());
+    image.residency = Residency::Resident;
+    stats.loads++;
+
+    // Just loaded because it was drawn, so keep the page for this frame
+    page->images.push_back(loaded.image);
+    page->frame = frame;
+    page->dirty = RasterUnion(page->dirty, { x, y, width, height });
+}
+
+bool TextureManager::Draw(uint32_t id, RasterRect rect, uint32_t layer)
+{
+    if (id == 0 || id > images.size()) return false;
+
+    Image& image = images[id - 1];
+    if (image.residency == Residency::Resident)
+    {
+        Page& page = pages[image.page];
+        page.frame = frame;
+        stats.hits++;
+
+        float scale = 1.0f / TEXTURE_PAGE_SIZE;
+        Quad quad = { (float)rect.x, (float)rect.y, (float)rect.width, (float)rect.height, image.x * scale, image.y * scale,
+                      (image.x + image.width) * scale, (image.y + image.height) * scale, 0xFFFFFFFF, 0xFFFFFFFF };
+        batch->Add(quad, page.texture, layer);
+        return true;
+    }
+
+    stats.misses++;
+
+    // Images beyond the queue limit are requested again on a later draw
+    if (image.residency == Residency::Absent && inFlight < TEXTURE_LOADS_IN_FLIGHT)
+    {
+        image.residency = Residency::Loading;
+        inFlight++;
+
+        SDL_LockMutex(mutex);
+        requests.push_back({ id, image.width, image.height });
+        SDL_UnlockMutex(mutex);
+        SDL_SemPost(wake);
+    }
+    return false;
+}
+
+void TextureManager::Upload()
+{
+    for (Page& page : pages)
+    {
+        if (RasterEmpty(page.dirty)) continue;
+
+        batch->UpdateTexture(page.texture, page.dirty);
+        stats.uploadBytes += (uint64_t)page.dirty.width * page.dirty.height * sizeof(uint32_t);
+        page.dirty = RasterRect();
+    }
+}
+
+void TextureManager::ResetStats()
+{
+    stats = TextureStats();
+}
+
+// Stands in for decoding: a size-dependent pattern in a color picked from the id
+static bool GenerateImage(void* context, uint32_t image, const RasterImage& target)
+{
+    (void)context;
+    uint32_t color = 0xFF000000 | (image * 2654435761u >> 8);
+
+    for (int32_t y = 0; y < target.height; ++y)
+    {
+        uint32_t* row = target.pixels + (size_t)y * target.stride;
+        for (int32_t x = 0; x < target.width; ++x)
+        {
+            row[x] = ((x ^ y) & 4) ? color : 0xFF202020;
+        }
+    }
+    return true;
+}
+
+void BenchmarkTextureManager(uint32_t budgetMegabytes)
+{
+    const uint32_t imageCount = 40000;
+    const uint32_t visible = 2000;      // images on screen at once
+    const uint32_t scroll = 250;        // images scrolled past per frame, one and a half times through the document
+    const uint32_t frames = 240;
+    const uint32_t frameMs = 16;        // the loader gets the time a frame at 60 Hz leaves
+    const int32_t width = 1280;
+    const int32_t height = 720;
+    const int32_t columns = 50;
+
+    std::vector<uint32_t> pixels((size_t)width * height);
+    RasterImage target = { pixels.data(), width, height, width };
+    TileRenderer renderer(0);
+
+    uint32_t budgets[2] = { budgetMegabytes, 0 };
+    if (budgetMegabytes == 0)
+    {
+        budgets[0] = 16;
+        budgets[1] = 256;
+    }
+
+    for (uint32_t budget : budgets)
+    {
+        if (budget == 0) continue;
+
+        QuadBatch batch;
+        batch.Initialize(nullptr, &renderer);
+        TextureManager manager;
+        if (!manager.Initialize(&batch, (size_t)budget << 20, GenerateImage, nullptr)) return;
+
+        // 16 to 64 pixels square or a little oblong, about 40k x 6 KB of pixels in all
+        uint32_t seed = 12345;
+        auto next = [&seed](uint32_t range) { seed = seed * 1664525 + 1013904223; return (seed >> 8) % range; };
+        std::vector<uint32_t> ids(imageCount);
+        for (uint32_t& id : ids)
+        {
+            int32_t size = 16 + (int32_t)next(49);
+            id = manager.Register(size, SDL_max(16, size - 8 + (int32_t)next(17)));
+        }
+
+        int32_t cellWidth = width / columns;
+        int32_t cellHeight = height / (int32_t)((visible + columns - 1) / columns);
+        Uint64 busy = 0;
+
+        for (uint32_t frame = 0; frame < frames; ++frame)
+        {
+            Uint64 start = SDL_GetPerformanceCounter();
+            manager.BeginFrame();
+            uint32_t first = frame * scroll;
+
+            for (uint32_t i = 0; i < visible; ++i)
+            {
+                RasterRect rect = { (int32_t)(i % columns) * cellWidth, height - (int32_t)(i / columns + 1) * cellHeight, cellWidth - 1, cellHeight - 1 };
+                if (!manager.Draw(ids[(first + i) % imageCount], rect))
+                {
+                    batch.Add(rect, 0xFF404040);
+                }
+            }
+
+            manager.Upload();
+            batch.Flush(width, height);
+            renderer.Render(target);
+
+            Uint64 elapsed = SDL_GetPerformanceCounter() - start;
+            Uint32 elapsedMs = (Uint32)(elapsed * 1000 / SDL_GetPerformanceFrequency());
+            if (elapsedMs < frameMs) SDL_Delay(frameMs - elapsedMs);
+            busy += elapsed;
+        }
+
+        double ms = (double)busy * 1000.0 / (double)SDL_GetPerformanceFrequency() / frames;
+        const TextureStats& stats = manager.Stats();
+        SDL_Log("Textures with a %u MB budget: %.2f ms/frame, %.1f%% hits, %.0f images missing per frame", budget, ms,
+                100.0 * stats.hits / SDL_max(1ull, stats.hits + stats.misses), stats.misses / (double)frames);
+        SDL_Log("  %llu loads, %.1f MB uploaded, %llu pages evicted, %llu loads deferred, peak %.1f MB",
+                (unsigned long long)stats.loads, stats.uploadBytes / 1048576.0, (unsigned long long)stats.evictions,
+                (unsigned long long)stats.deferred, stats.peakBytes / 1048576.0);
+    }
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <SDL.h>
+
+#include "Raster.h"
+
+class QuadBatch;
+
+
+// Keeps many small images resident in a few atlas pages within a memory budget. Images are loaded
+// on a background thread the first time they are drawn and packed into a page by a skyline packer;
+// until then Draw reports them missing so the caller can draw a placeholder. When the budget is used
+// up the least recently drawn page is emptied and reused, and its images are loaded again when they
+// come back into view. Pages that received images for the current frame are never emptied.
+#define TEXTURE_PAGE_SIZE       1024            // page width and height
+#define TEXTURE_PAGE_PADDING    1               // empty pixels right of and above every image so sampling never bleeds
+#define TEXTURE_LOADS_IN_FLIGHT 1024            // requests queued or loaded but not yet placed
+
+// Writes the premultiplied BGRA pixels of image into target, which has the registered size; runs on the loader thread
+typedef bool (*TextureLoader)(void* context, uint32_t image, const RasterImage& target);
+
+struct TextureStats
+{
+    uint64_t hits;          // draws of resident images
+    uint64_t misses;        // draws of images still loading or evicted
+    uint64_t loads;         // images placed in a page; a deferred image counts once it is placed
+    uint64_t uploadBytes;   // sent to page textures
+    uint64_t evictions;     // pages emptied for reuse
+    uint64_t deferred;      // loaded images without room, since every page received images this frame
+    size_t peakBytes;       // pages plus loaded pixels waiting to be placed
+};
+
+// Bottom-left skyline packing of rectangles into a fixed area
+class SkylinePacker
+{
+public:
+    void Reset(int32_t width, int32_t height);
+    bool Insert(int32_t width, int32_t height, int32_t& x, int32_t& y);
+
+private:
+    struct Segment
+    {
+        int32_t x;
+        int32_t y;          // height of the skyline over [x, x + width)
+        int32_t width;
+    };
+
+    // Lowest y a rectangle of width fits at when its left edge is on segment, -1 if it does not fit
+    int32_t Fit(size_t segment, int32_t width, int32_t height) const;
+
+    int32_t areaWidth;
+    int32_t areaHeight;
+    std::vector<Segment> skyline;
+};
+
+class TextureManager
+{
+public:
+    TextureManager();
+    ~TextureManager();
+
+    // Starts the loader thread; pages are registered with batch, which must outlive the manager
+    bool Initialize(QuadBatch* batch, size_t budget, TextureLoader loader, void* context);
+
+    // Declares an image of width x height; returns its id, 0 when it cannot fit a page
+    uint32_t Register(int32_t width, int32_t height);
+
+    // Places the images loaded since the last frame; call before drawing a frame
+    void BeginFrame();
+
+    // Adds a quad drawing image into rect; returns false and requests the image when it is not resident
+    bool Draw(uint32_t image, RasterRect rect, uint32_t layer = 0);
+
+    // Sends the images placed this frame to their page textures; run before flushing the batch
+    void Upload();
+
+    size_t PageBytes() const { return pages.size() * (size_t)TEXTURE_PAGE_SIZE * TEXTURE_PAGE_SIZE * sizeof(uint32_t); }
+
+    const TextureStats& Stats() const { return stats; }
+    void ResetStats();
+
+private:
+    enum class Residency : uint8_t
+    {
+        Absent,
+        Loading,
+        Resident,
+        Failed
+    };
+
+    struct Image
+    {
+        int32_t width;
+        int32_t height;
+        int32_t x;              // position in the page while resident
+        int32_t y;
+        uint32_t page;
+        Residency residency;
+    };
+
+    struct Page
+    {
+        std::vector<uint32_t> pixels;
+        RasterImage image;
+        uint32_t texture;
+        SkylinePacker packer;
+        std::vector<uint32_t> images;   // resident in this page
+        uint32_t frame;                 // last frame that drew from it
+        RasterRect dirty;               // placed since the last upload
+    };
+
+    struct Request
+    {
+        uint32_t image;
+        int32_t width;
+        int32_t height;
+    };
+
+    struct Loaded
+    {
+        uint32_t image;
+        bool valid;
+        std::vector<uint32_t> pixels;
+    };
+
+    static int LoaderMain(void* data);
+    void Place(Loaded& loaded);
+    Page* FindRoom(int32_t width, int32_t height, int32_t& x, int32_t& y);
+
+    QuadBatch* batch;
+    TextureLoader loader;
+    void* context;
+
+    std::vector<Image> images;          // id - 1
+    std::vector<Page> pages;            // reserved up front; the batch keeps pointers to the page images
+    size_t maxPages;
+    uint32_t inFlight;
+    uint32_t frame;
+    std::vector<Loaded> placing;        // swapped with completed, so placing runs without the lock
+
+    // shared with the loader thread
+    SDL_Thread* thread;
+    SDL_mutex* mutex;
+    SDL_sem* wake;
+    std::deque<Request> requests;
+    std::vector<Loaded> completed;
+    std::atomic<size_t> loadedBytes;
+    bool stopping;
+
+    TextureStats stats;
+};
+
+// Scrolls through 40k small generated images under a small and a large budget and logs hit rates,
+// upload bytes and peak memory; budgetMegabytes 0 uses 16 and 256 MB
+void BenchmarkTextureManager(uint32_t budgetMegabytes);
@@ -0,0 +1,256 @@
+#include "TileRenderer.h"
+
+#include <string.h>
+
+TileRenderer::TileRenderer(uint32_t threads)
+    : threadCount(threads > 0 ? threads : (uint32_t)SDL_GetCPUCount()), startSemaphore(nullptr), doneSemaphore(nullptr),
+      running(0), stopping(false), target(), clip(), tilesX(0), tilesY(0)
+{
+    queues.reset(new TileQueue[threadCount]);
+    workers.resize(threadCount);
+
+    if (threadCount > 1)
+    {
+        startSemaphore = SDL_CreateSemaphore(0);
+        doneSemaphore = SDL_CreateSemaphore(0);
+    }
+
+    // Worker 0 is whoever calls Render
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        workers[i].renderer = this;
+        workers[i].index = i;
+        workers[i].thread = i > 0 ? SDL_CreateThread(WorkerMain, "Tiles", &workers[i]) : nullptr;
+    }
+}
+
+TileRenderer::~TileRenderer()
+{
+    stopping = true;
+
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        SDL_SemPost(startSemaphore);
+    }
+
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        SDL_WaitThread(workers[i].thread, nullptr);
+    }
+
+    if (startSemaphore) SDL_DestroySemaphore(startSemaphore);
+    if (doneSemaphore) SDL_DestroySemaphore(doneSemaphore);
+}
+
+void TileRenderer::Fill(RasterRect rect, uint32_t color)
+{
+    commands.push_back({ RasterCommandType::Fill, rect, color, 0, nullptr });
+}
+
+void TileRenderer::FillGradient(RasterRect rect, uint32_t left, uint32_t right)
+{
+    commands.push_back({ RasterCommandType::Gradient, rect, left, right, nullptr });
+}
+
+void TileRenderer::Blend(RasterRect rect, uint32_t color)
+{
+    commands.push_back({ RasterCommandType::Blend, rect, color, 0, nullptr });
+}
+
+void TileRenderer::DrawImage(RasterRect rect, const RasterImage* texture)
+{
+    commands.push_back({ RasterCommandType::Image, rect, 0, 0, texture });
+}
+
+void TileRenderer::Render(const RasterImage& image)
+{
+    Render(image, { 0, 0, image.width, image.height });
+}
+
+void TileRenderer::Render(const RasterImage& image, RasterRect area)
+{
+    target = image;
+    clip = RasterIntersect(area, { 0, 0, image.width, image.height });
+    tilesX = (uint32_t)(image.width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (uint32_t)(image.height + TILE_SIZE - 1) / TILE_SIZE;
+    Bin();
+
+    // Hand each worker a contiguous run of tiles so neighbours share cache lines of the target
+    uint32_t tileCount = tilesX * tilesY;
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        queues[i].next.store(tileCount * i / threadCount, std::memory_order_relaxed);
+        queues[i].end = tileCount * (i + 1) / threadCount;
+    }
+
+    running.store(threadCount, std::memory_order_relaxed);
+
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        SDL_SemPost(startSemaphore);
+    }
+
+    RenderTiles(0);
+
+    // The last worker to finish wakes the caller
+    if (running.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    {
+        SDL_SemWait(doneSemaphore);
+    }
+
+    commands.clear();
+}
+
+int TileRenderer::WorkerMain(void* data)
+{
+    Worker* worker = (Worker*)data;
+    TileRenderer* renderer = worker->renderer;
+
+    for (;;)
+    {
+        SDL_SemWait(renderer->startSemaphore);
+        if (renderer->stopping) return 0;
+
+        renderer->RenderTiles(worker->index);
+
+        if (renderer->running.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            SDL_SemPost(renderer->doneSemaphore);
+        }
+    }
+}
+
+void TileRenderer::Bin()
+{
+    bins.resize(tilesX * tilesY);
+    for (std::vector<uint32_t>& bin : bins)
+    {
+        bin.clear();
+    }
+
+    for (uint32_t i = 0; i < (uint32_t)commands.size(); ++i)
+    {
+        RasterRect rect = RasterIntersect(commands[i].rect, clip);
+        if (RasterEmpty(rect)) continue;
+
+        for (int32_t y = rect.y / TILE_SIZE; y <= (rect.y + rect.height - 1) / TILE_SIZE; ++y)
+        {
+            for (int32_t x = rect.x / TILE_SIZE; x <= (rect.x + rect.width - 1) / TILE_SIZE; ++x)
+            {
+                bins[y * tilesX + x].push_back(i);
+            }
+        }
+    }
+}
+
+void TileRenderer::RenderTiles(uint32_t worker)
+{
+    // Drain our own queue first, then steal from the others in turn
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        TileQueue& queue = queues[(worker + i) % threadCount];
+
+        for (;;)
+        {
+            uint32_t tile = queue.next.fetch_add(1, std::memory_order_relaxed);
+            if (tile >= queue.end) break;
+            RenderTile(tile);
+        }
+    }
+}
+
+void TileRenderer::RenderTile(uint32_t tile)
+{
+    if (bins[tile].empty()) return;
+
+    RasterRect area = { (int32_t)(tile % tilesX) * TILE_SIZE, (int32_t)(tile / tilesX) * TILE_SIZE, TILE_SIZE, TILE_SIZE };
+    area = RasterIntersect(area, clip);
+    int32_t x = area.x;
+    int32_t y = area.y;
+
+    // The clipped tile is an image of its own sharing the target's rows; commands move into its coordinates
+    RasterImage image;
+    image.pixels = target.pixels + (size_t)y * target.stride + x;
+    image.width = area.width;
+    image.height = area.height;
+    image.stride = target.stride;
+
+    for (uint32_t index : bins[tile])
+    {
+        const RasterCommand& command = commands[index];
+        RasterRect rect = { command.rect.x - x, command.rect.y - y, command.rect.width, command.rect.height };
+
+        switch (command.type)
+        {
+            case RasterCommandType::Fill: RasterFillRect(image, rect, command.color); break;
+            case RasterCommandType::Gradient: RasterFillGradient(image, rect, command.color, command.color2); break;
+            case RasterCommandType::Blend: RasterBlendRect(image, rect, command.color); break;
+            case RasterCommandType::Image: RasterDrawImage(image, rect, *command.texture); break;
+        }
+    }
+}
+
+void BenchmarkTileRenderer(int32_t width, int32_t height)
+{
+    const uint32_t frames = 20;
+    const uint32_t shapes = 400;
+
+    // Translucent premultiplied texture
+    std::vector<uint32_t> texels(128 * 128);
+    for (uint32_t i = 0; i < texels.size(); ++i)
+    {
+        uint32_t a = 128 + (i & 127);
+        texels[i] = a << 24 | ((i * 7 & 0xFF) * a / 255) << 16 | ((i * 13 & 0xFF) * a / 255) << 8 | ((i >> 7) * a / 255);
+    }
+    RasterImage texture = { texels.data(), 128, 128, 128 };
+
+    std::vector<uint32_t> pixels((size_t)width * height);
+    std::vector<uint32_t> reference;
+    RasterImage image = { pixels.data(), width, height, width };
+
+    uint32_t cores = (uint32_t)SDL_GetCPUCount();
+    SDL_Log("Tile renderer at %dx%d, %u shapes, %s kernels, %u cores", width, height, shapes, SelectRasterKernels()->name, cores);
+
+    double baseline = 0.0;
+
+    for (uint32_t threads = 1; threads <= cores; threads = threads < cores && threads * 2 > cores ? cores : threads * 2)
+    {
+        TileRenderer renderer(threads);
+        Uint64 elapsed = 0;
+
+        for (uint32_t frame = 0; frame < frames + 1; ++frame)
+        {
+            // Same pseudo-random scene every frame
+            uint32_t seed = 12345;
+            auto next = [&seed](uint32_t range) { seed = seed * 1664525 + 1013904223; return (seed >> 8) % range; };
+
+            renderer.FillGradient({ 0, 0, width, height }, 0xFF203040, 0xFF6080A0);
+
+            for (uint32_t i = 0; i < shapes; ++i)
+            {
+                RasterRect rect = { (int32_t)next(width), (int32_t)next(height), (int32_t)next(width / 4) + 8, (int32_t)next(height / 4) + 8 };
+
+                switch (i % 4)
+                {
+                    case 0: renderer.Fill(rect, 0xFF000000 | next(0xFFFFFF)); break;
+                    case 1: renderer.FillGradient(rect, 0xFF0000FF, 0xFFFF8000); break;
+                    case 2: renderer.Blend(rect, 0x80402010); break;
+                    case 3: renderer.DrawImage(rect, &texture); break;
+                }
+            }
+
+            // The first frame warms up caches and threads
+            Uint64 start = SDL_GetPerformanceCounter();
+            renderer.Render(image);
+            if (frame > 0) elapsed += SDL_GetPerformanceCounter() - start;
+        }
+
+        if (threads == 1) reference = pixels;
+        bool matches = memcmp(reference.data(), pixels.data(), pixels.size() * sizeof(uint32_t)) == 0;
+
+        double ms = (double)elapsed * 1000.0 / (double)SDL_GetPerformanceFrequency() / frames;
+        if (threads == 1) baseline = ms;
+
+        SDL_Log("%3u threads %8.2f ms/frame %7.1f frames/s %5.2fx%s", threads, ms, 1000.0 / ms, baseline / ms, matches ? "" : "  MISMATCH");
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <SDL.h>
+
+#include "Raster.h"
+
+
+// Renders a frame of raster commands on several threads. Commands are first binned into the
+// screen tiles they touch, then whole tiles are rendered independently, so no two threads write
+// the same pixels and the result matches drawing every command in order on one thread. Each
+// worker starts on its own contiguous share of the tiles and steals from the others once it runs dry.
+#define TILE_SIZE           64
+#define TILE_CACHE_LINE     64
+
+enum class RasterCommandType
+{
+    Fill,
+    Gradient,
+    Blend,
+    Image
+};
+
+struct RasterCommand
+{
+    RasterCommandType type;
+    RasterRect rect;
+    uint32_t color;                 // fill or blend color, left gradient color
+    uint32_t color2;                // right gradient color
+    const RasterImage* texture;     // must outlive Render
+};
+
+class TileRenderer
+{
+public:
+    // threads 0 uses one per core; the calling thread is one of them
+    explicit TileRenderer(uint32_t threads);
+    ~TileRenderer();
+
+    uint32_t Threads() const { return threadCount; }
+
+    void Fill(RasterRect rect, uint32_t color);
+    void FillGradient(RasterRect rect, uint32_t left, uint32_t right);
+    void Blend(RasterRect rect, uint32_t color);
+    void DrawImage(RasterRect rect, const RasterImage* texture);
+
+    // Draws everything submitted since the last call into image, touching only pixels inside clip
+    void Render(const RasterImage& image);
+    void Render(const RasterImage& image, RasterRect clip);
+
+private:
+    struct Worker
+    {
+        TileRenderer* renderer;
+        uint32_t index;
+        SDL_Thread* thread;
+    };
+
+    // Tiles [next, end) of one worker; anyone may take the next one
+    struct TileQueue
+    {
+        alignas(TILE_CACHE_LINE) std::atomic<uint32_t> next;
+        uint32_t end;
+    };
+
+    static int WorkerMain(void* data);
+    void Bin();
+    void RenderTiles(uint32_t worker);
+    void RenderTile(uint32_t tile);
+
+    uint32_t threadCount;
+    std::vector<Worker> workers;
+    std::unique_ptr<TileQueue[]> queues;
+    SDL_sem* startSemaphore;
+    SDL_sem* doneSemaphore;
+    std::atomic<uint32_t> running;
+    bool stopping;
+
+    std::vector<RasterCommand> commands;
+    std::vector<std::vector<uint32_t>> bins;    // command indices per tile, in submission order
+    RasterImage target;
+    RasterRect clip;
+    uint32_t tilesX;
+    uint32_t tilesY;
+};
+
+// Renders a generated scene at 1..N threads and logs frame times and speedup over one thread
+void BenchmarkTileRenderer(int32_t width, int32_t height);
@@ -1,9 +1,16 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <commdlg.h>
 #include <pathcch.h>
+#include <psapi.h>
+#include <shellapi.h>
 #include <tchar.h>
 
+#include <algorithm>
 #include <string>
+#include <vector>
+
+#include <Protocol.h>
 
 
 // dialogs
@@ -20,11 +27,117 @@
 #define IDM_LAYOUT_RESET    2013
 #define IDM_HELP_ABOUT      2021
 
+// timers
+#define IDT_CPU_REPORT      3001
+#define IDT_SIZE_MOVE       3002
+#define IDT_RESIZE_BENCH    3003
+#define IDT_WATCH_DEBOUNCE  3004
+#define IDT_IPC_BENCH       3005
+#define IDT_EMBED_SETTLE    3006
+#define IDT_CHILD_RESPAWN   3007
+
+#define RESIZE_BENCH_STALL_MS   50  // gap between presented frames counted as a stall
+#define IPC_BENCH_IN_FLIGHT     4   // pings outstanding at once; a full ring would measure queueing, not round trips
+#define IPC_BENCH_TIMEOUT_MS    5000    // without a pong for this long the benchmark gives up
+#define WATCH_DEBOUNCE_MS       100 // quiet time after the last change to the document before reloading it
+#define EMBED_GRANULARITY       256 // grow an embedded child window in steps of this many pixels
+#define EMBED_SETTLE_MS         250 // shrink it to the client area once resizing stopped this long
+#define CHILD_RESPAWN_MS        250 // delay before replacing a child that exited while starting, doubled for each one after
+#define CHILD_RESPAWN_LIMIT     5   // children exiting while starting in a row before the pool stops refilling
+
 typedef std::basic_string<TCHAR> TSTR;
 
-static HWND ChildHwnd = NULL;
+enum class ChildState
+{
+    Starting,   // process created, SDL/GL initialization in progress
+    Parked,     // initialized, hidden child window waiting to be adopted
+    Active      // adopted and shown in the client area
+};
+
+struct ChildProcess
+{
+    PROCESS_INFORMATION process;
+    ChildState state;
+    HWND hwnd;
+    HANDLE pipe;                // write end of the handshake pipe
+    HANDLE commandEvent;        // wakes the child while it waits for commands
+    HANDLE mapping;             // shared ChildChannel
+    ChildChannel* channel;
+    Ring commands;              // produced by Parent
+    Ring replies;               // consumed by Parent
+    HANDLE framebufferMapping;  // shared framebuffer, framebuffer mode only
+    FramebufferHeader* framebuffer;
+    TripleBufferReader frontBuffer;
+    ChildSize sentSize;         // last size sent with CHILD_COMMAND_RESIZE or CHILD_COMMAND_ADOPT
+    ChildSize pendingSize;      // latest client size, sent once the child presents a frame
+    bool resizeInFlight;        // a resize was sent and no frame has been presented since
+    ChildSize embedSize;        // embedded window size, at least the client area, embedded mode only
+    ChildPoint pendingPointer;  // latest pointer position not yet sent, framebuffer mode only
+    bool pointerPending;        // pendingPointer waits for room in the command queue
+    uint32_t acquiredSequence;  // frame sequence of the front slot, its damage is relative to the one before
+    LARGE_INTEGER spawnTime;
+};
+
 static const TSTR ChildWindowClass = _T("Child");
 static const TSTR ParentWindowClass = _T("Parent");
+static const TSTR ChildReadyMessageName = _T("ParentChildReady");
+
+static UINT ChildReadyMessage = 0;
+static TCHAR ChildPath[MAX_PATH];
+static std::vector<ChildProcess> Children;
+static size_t ChildPoolSize = 2;
+static bool AdoptPending = true;
+static bool FramebufferMode = false;
+static bool OnDemandMode = false;
+static bool SoftwareMode = false;
+static uint32_t FrameRate = 60;
+static uint32_t RenderCost = 0;
+static uint32_t RenderThreads = 0;
+static HANDLE ReplyEvent = NULL;
+static UINT CpuReportInterval = 0;
+static size_t RefillCount = 0;
+static LARGE_INTEGER RefillStart;
+static uint32_t ChildStartFailures = 0; // children in a row that exited before they were ready
+static bool RespawnWaiting = false;     // IDT_CHILD_RESPAWN holds back the refill
+static std::wstring DocumentPath;   // opened in every adopted child until File > New or Close
+
+// document file watch, one per Parent whatever the number of children
+static HANDLE WatchDirectory = INVALID_HANDLE_VALUE;
+static HANDLE WatchEvent = NULL;        // manual reset, signaled when a read of changes completes
+static OVERLAPPED WatchOverlapped;
+static DWORD WatchBuffer[16384];        // FILE_NOTIFY_INFORMATION records, which must be DWORD aligned
+static bool WatchChanged = false;       // a change waits for the debounce timer
+static bool WatchReloading = false;     // a reload was sent for it, waiting on the reply
+static bool WatchPresenting = false;    // the reply came, waiting on the first frame after it
+static LARGE_INTEGER WatchChangeTime;   // of the first change in the burst
+static LARGE_INTEGER WatchReloadTime;
+static LARGE_INTEGER WatchReplyTime;
+
+// presentation statistics in framebuffer mode
+static uint32_t PresentedFrames = 0;
+static unsigned long long PresentedBytes = 0;
+static LARGE_INTEGER PresentStatsStart;
+static bool PointerTracked = false;
+
+// round trip benchmark over the command ring (-benchipc N)
+static uint32_t IpcBenchMessages = 0;
+static uint32_t IpcBenchSent = 0;
+static uint32_t IpcBenchReceived = 0;
+static DWORD IpcBenchProcessId = 0;
+static LARGE_INTEGER IpcBenchStart;
+static LARGE_INTEGER IpcBenchLastPong;
+static std::vector<double> IpcBenchLatencies;
+
+// scripted live resize benchmark (-benchresize N)
+static uint32_t ResizeBenchSteps = 0;
+static uint32_t ResizeBenchStep = 0;
+static uint32_t ResizeBenchSizes = 0;
+static uint32_t ResizeBenchCommands = 0;
+static uint32_t ResizeBenchFrames = 0;
+static uint32_t ResizeBenchStalls = 0;
+static double ResizeBenchLongestGap = 0.0;
+static LARGE_INTEGER ResizeBenchLastFrame;
+static RECT ResizeBenchRect;
 
 INT_PTR CALLBACK About(HWND, UINT, WPARAM, LPARAM);
 
@@ -47,19 +160,986 @@ void LastErrorMessageBox()
     MessageBox(NULL, LastErrorMessage().c_str(), _T("ERROR"), MB_ICONEXCLAMATION | MB_OK);
 }
 
-BOOL CALLBACK GetChildHWND(HWND hWnd, LPARAM lParam)
+double ElapsedMilliseconds(const LARGE_INTEGER& since)
 {
-    ChildHwnd = NULL;
-    TCHAR wndClassName[1024];
-    GetClassName(hWnd, wndClassName, 1024);
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)(now.QuadPart - since.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+}
 
-    if (_tcscmp(wndClassName, _T("SDL_app")) == 0)
+void ReportCpuUsage()
+{
+    static unsigned long long lastCpu = 0, lastWall = 0;
+
+    FILETIME creationTime, exitTime, kernelTime, userTime, now;
+    GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime);
+    GetSystemTimeAsFileTime(&now);
+
+    auto ticks = [](const FILETIME& ft) { return ((unsigned long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime; };
+    unsigned long long cpu = ticks(kernelTime) + ticks(userTime);
+    unsigned long long wall = ticks(now);
+
+    if (lastWall != 0 && wall > lastWall)
     {
-        ChildHwnd = hWnd;
-        return FALSE; // stop enumerating
+        double cpuMs = (cpu - lastCpu) / 10000.0;
+        double wallMs = (wall - lastWall) / 10000.0;
+        _tprintf(_T("Parent used %.1f ms CPU in %.1f s (%.2f%% of a core)\n"), cpuMs, wallMs / 1000.0, cpuMs * 100.0 / wallMs);
     }
 
-    return TRUE;
+    lastCpu = cpu;
+    lastWall = wall;
+}
+
+ChildProcess* FindChild(ChildState state)
+{
+    for (ChildProcess& child : Children)
+    {
+        if (child.state == state) return &child;
+    }
+
+    return NULL;
+}
+
+void ReleaseChild(ChildProcess& child)
+{
+    if (child.framebuffer) UnmapViewOfFile(child.framebuffer);
+    if (child.framebufferMapping) CloseHandle(child.framebufferMapping);
+    if (child.commandEvent) CloseHandle(child.commandEvent);
+    if (child.channel) UnmapViewOfFile(child.channel);
+    if (child.mapping) CloseHandle(child.mapping);
+    if (child.pipe) CloseHandle(child.pipe);
+    if (child.process.hThread) CloseHandle(child.process.hThread);
+    if (child.process.hProcess) CloseHandle(child.process.hProcess);
+}
+
+bool SpawnChild(HWND hWnd)
+{
+    ChildProcess child = {};
+    child.state = ChildState::Starting;
+
+    // Create handshake pipe; only the read end is inheritable
+    SECURITY_ATTRIBUTES sa;
+    sa.nLength = sizeof(SECURITY_ATTRIBUTES);
+    sa.lpSecurityDescriptor = NULL;
+    sa.bInheritHandle = TRUE;
+
+    HANDLE pipeRead = NULL;
+    if (!CreatePipe(&pipeRead, &child.pipe, &sa, 0) || !SetHandleInformation(child.pipe, HANDLE_FLAG_INHERIT, 0))
+    {
+        _tprintf(_T("Failed to create handshake pipe: %ls"), LastErrorMessage().c_str());
+        if (pipeRead) CloseHandle(pipeRead);
+        ReleaseChild(child);
+        return false;
+    }
+
+    // Create command and reply rings in shared memory
+    child.mapping = CreateFileMapping(INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE, 0, sizeof(ChildChannel), NULL);
+    child.channel = child.mapping ? (ChildChannel*)MapViewOfFile(child.mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ChildChannel)) : NULL;
+
+    if (child.channel == NULL)
+    {
+        _tprintf(_T("Failed to create child channel: %ls"), LastErrorMessage().c_str());
+        CloseHandle(pipeRead);
+        ReleaseChild(child);
+        return false;
+    }
+
+    child.commandEvent = CreateEvent(&sa, FALSE, FALSE, NULL);
+    if (child.commandEvent == NULL)
+    {
+        _tprintf(_T("Failed to create child command event: %ls"), LastErrorMessage().c_str());
+        CloseHandle(pipeRead);
+        ReleaseChild(child);
+        return false;
+    }
+
+    Ring::Initialize(&child.channel->commands);
+    Ring::Initialize(&child.channel->replies);
+    child.commands = Ring(&child.channel->commands, child.channel->commandData, CHILD_RING_CAPACITY);
+    child.replies = Ring(&child.channel->replies, child.channel->replyData, CHILD_RING_CAPACITY);
+
+    // Reserve framebuffer slots large enough for the whole desktop so resizing never remaps
+    if (FramebufferMode)
+    {
+        int32_t maxWidth = GetSystemMetrics(SM_CXVIRTUALSCREEN);
+        int32_t maxHeight = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+        unsigned long long size = FramebufferMappingSize(maxWidth, maxHeight);
+
+        child.framebufferMapping = CreateFileMapping(INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE | SEC_RESERVE, (DWORD)(size >> 32), (DWORD)size, NULL);
+        child.framebuffer = child.framebufferMapping ? (FramebufferHeader*)MapViewOfFile(child.framebufferMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : NULL;
+
+        // Only the header is committed here; Child commits as much of each slot as its frames need
+        if (child.framebuffer != NULL && !VirtualAlloc(child.framebuffer, FRAMEBUFFER_ALIGNMENT, MEM_COMMIT, PAGE_READWRITE))
+        {
+            UnmapViewOfFile(child.framebuffer);
+            child.framebuffer = NULL;
+        }
+
+        if (child.framebuffer == NULL)
+        {
+            _tprintf(_T("Failed to create child framebuffer: %ls"), LastErrorMessage().c_str());
+            CloseHandle(pipeRead);
+            ReleaseChild(child);
+            return false;
+        }
+
+        InitializeTripleBuffer(&child.framebuffer->middle);
+        child.framebuffer->maxWidth = maxWidth;
+        child.framebuffer->maxHeight = maxHeight;
+        child.frontBuffer = TripleBufferReader(&child.framebuffer->middle);
+    }
+
+    // Restrict inheritance to the pipe, event and mappings so concurrently spawned children do not pick up each other's handles
+    HANDLE inherited[5] = { pipeRead, ReplyEvent, child.commandEvent, child.mapping, child.framebufferMapping };
+    DWORD inheritedCount = child.framebufferMapping ? 5 : 4;
+    SIZE_T attributeListSize = 0;
+    InitializeProcThreadAttributeList(NULL, 1, 0, &attributeListSize);
+    std::vector<BYTE> attributeList(attributeListSize);
+
+    // Set child process startup and process info
+    STARTUPINFOEX lpStartupInfo;
+    ZeroMemory(&lpStartupInfo, sizeof(STARTUPINFOEX));
+    lpStartupInfo.StartupInfo.cb = sizeof(lpStartupInfo);
+    lpStartupInfo.lpAttributeList = (LPPROC_THREAD_ATTRIBUTE_LIST)attributeList.data();
+
+    if (!InitializeProcThreadAttributeList(lpStartupInfo.lpAttributeList, 1, 0, &attributeListSize) ||
+        !UpdateProcThreadAttribute(lpStartupInfo.lpAttributeList, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherited, inheritedCount * sizeof(HANDLE), NULL, NULL))
+    {
+        _tprintf(_T("Failed to set up child handle list: %ls"), LastErrorMessage().c_str());
+        CloseHandle(pipeRead);
+        ReleaseChild(child);
+        return false;
+    }
+
+    TCHAR lpCommandLine[1024];
+    _stprintf_s(lpCommandLine, _T("%ls %llu"), ChildPath, (unsigned long long)(ULONG_PTR)pipeRead);
+
+    // Create process
+    QueryPerformanceCounter(&child.spawnTime);
+    BOOL success = CreateProcess(ChildPath, lpCommandLine, NULL, NULL, TRUE, EXTENDED_STARTUPINFO_PRESENT, NULL, NULL,
+                                 &lpStartupInfo.StartupInfo, &child.process);
+
+    DeleteProcThreadAttributeList(lpStartupInfo.lpAttributeList);
+    CloseHandle(pipeRead);
+
+    if (!success)
+    {
+        _tprintf(_T("Failed to start child: %ls"), LastErrorMessage().c_str());
+        ReleaseChild(child);
+        return false;
+    }
+
+    // Send hello; it fits in the pipe buffer, so this does not wait for the child
+    RECT cr; // client rectangle
+    GetClientRect(hWnd, &cr);
+
+    ChildHello hello;
+    ZeroMemory(&hello, sizeof(ChildHello));
+    hello.magic = CHILD_PROTOCOL_MAGIC;
+    hello.version = CHILD_PROTOCOL_VERSION;
+    hello.size = sizeof(ChildHello);
+    hello.capabilities = FramebufferMode ? CHILD_CAPABILITY_FRAMEBUFFER : CHILD_CAPABILITY_EMBED;
+    if (OnDemandMode) hello.capabilities |= CHILD_CAPABILITY_ON_DEMAND;
+    if (SoftwareMode) hello.capabilities |= CHILD_CAPABILITY_SOFTWARE;
+    hello.parentWindow = (uint64_t)(ULONG_PTR)hWnd;
+    hello.parentProcessId = GetCurrentProcessId();
+    hello.width = cr.right - cr.left;
+    hello.height = cr.bottom - cr.top;
+    hello.frameRate = FrameRate;
+    hello.renderCost = RenderCost;
+    hello.renderThreads = RenderThreads;
+    hello.channel = (uint64_t)(ULONG_PTR)child.mapping;
+    hello.framebuffer = (uint64_t)(ULONG_PTR)child.framebufferMapping;
+    hello.replyEvent = (uint64_t)(ULONG_PTR)ReplyEvent;
+    hello.commandEvent = (uint64_t)(ULONG_PTR)child.commandEvent;
+
+    DWORD written = 0;
+    if (!WriteFile(child.pipe, &hello, sizeof(ChildHello), &written, NULL) || written != sizeof(ChildHello))
+    {
+        _tprintf(_T("Failed to send hello to child %d: %ls"), child.process.dwProcessId, LastErrorMessage().c_str());
+    }
+
+    Children.push_back(child);
+    return true;
+}
+
+void NotifyChild(ChildProcess& child)
+{
+    // Pairs with the child setting childWaiting before its final check; only wake it when it actually sleeps
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (child.channel->childWaiting.load(std::memory_order_relaxed))
+    {
+        SetEvent(child.commandEvent);
+    }
+}
+
+bool PushCommand(ChildProcess& child, uint32_t type, const void* payload, uint32_t size)
+{
+    if (!child.commands.Push(type, payload, size))
+    {
+        _tprintf(_T("Command queue of child %d is full\n"), child.process.dwProcessId);
+        return false;
+    }
+
+    NotifyChild(child);
+    return true;
+}
+
+// The pool stands in for a zygote. Win32 cannot fork, and a process created by a pre-initialized child
+// starts from its image just like one created here: it shares no initialized pages with its creator, so
+// a spawning child would only add a hop. What a zygote would share, the SDL, GL driver and C runtime
+// images, Windows already shares between children as image mappings.
+void RefillChildPool(HWND hWnd)
+{
+    // A child that cannot start would otherwise be replaced as fast as it exits
+    if (RespawnWaiting || ChildStartFailures >= CHILD_RESPAWN_LIMIT) return;
+
+    // Keep enough children starting or parked so that the next File > New does not wait on a cold start
+    size_t available = 0;
+    for (const ChildProcess& child : Children)
+    {
+        if (child.state != ChildState::Active) available++;
+    }
+
+    if (available < ChildPoolSize && FindChild(ChildState::Starting) == NULL)
+    {
+        // Start of a new refill batch; all missing children are spawned at once and initialize in parallel
+        QueryPerformanceCounter(&RefillStart);
+        RefillCount = 0;
+    }
+
+    while (available < ChildPoolSize && SpawnChild(hWnd))
+    {
+        available++;
+        RefillCount++;
+    }
+}
+
+void FlushResize(ChildProcess& child)
+{
+    // At most one resize per presented frame; later sizes replace the pending one
+    if (child.resizeInFlight) return;
+    if (child.pendingSize.width == child.sentSize.width && child.pendingSize.height == child.sentSize.height) return;
+
+    if (PushCommand(child, CHILD_COMMAND_RESIZE, &child.pendingSize, sizeof(ChildSize)))
+    {
+        child.sentSize = child.pendingSize;
+        child.resizeInFlight = true;
+        if (ResizeBenchStep > 0) ResizeBenchCommands++;
+    }
+}
+
+void FlushPointer(ChildProcess& child)
+{
+    // Pointer moves outpace a busy child; only the latest point waits for room, and a full queue is not worth a log line
+    if (!child.pointerPending) return;
+    if (!child.commands.Push(CHILD_COMMAND_POINTER, &child.pendingPointer, sizeof(ChildPoint))) return;
+
+    child.pointerPending = false;
+    NotifyChild(child);
+}
+
+// Anchors the bottom left of an embedded window to the client area, so only its bottom left part is visible
+void PlaceEmbeddedChild(ChildProcess& child, const RECT& cr)
+{
+    // Do not block on the child's thread; the window manager coalesces queued positions
+    SetWindowPos(child.hwnd, NULL, cr.left, cr.bottom - child.embedSize.height, child.embedSize.width, child.embedSize.height,
+                 SWP_ASYNCWINDOWPOS | SWP_NOZORDER | SWP_NOACTIVATE | SWP_NOREDRAW);
+}
+
+void ResizeChild(HWND hWnd, ChildProcess& child)
+{
+    // Resize child to content inner content of parent
+    RECT cr; // client rectangle
+    GetClientRect(hWnd, &cr);
+
+    if (cr.left >= 0 && cr.right >= 0 && cr.top >= 0 && cr.bottom >= 0)
+    {
+        if (child.framebuffer != NULL)
+        {
+            child.pendingSize = { cr.right - cr.left, cr.bottom - cr.top };
+            FlushResize(child);
+        }
+        else
+        {
+            // Resizing the window reallocates its surface, so it grows with headroom like framebuffer storage
+            // and shrinks once resizing settles. The child draws the client size from its bottom left corner.
+            ChildSize size = { cr.right - cr.left, cr.bottom - cr.top };
+            if (size.width > child.embedSize.width) child.embedSize.width = std::max(size.width, child.embedSize.width + EMBED_GRANULARITY);
+            if (size.height > child.embedSize.height) child.embedSize.height = std::max(size.height, child.embedSize.height + EMBED_GRANULARITY);
+
+            PlaceEmbeddedChild(child, cr);
+            if (child.embedSize.width != size.width || child.embedSize.height != size.height) SetTimer(hWnd, IDT_EMBED_SETTLE, EMBED_SETTLE_MS, NULL);
+
+            if (size.width != child.sentSize.width || size.height != child.sentSize.height)
+            {
+                if (PushCommand(child, CHILD_COMMAND_RESIZE, &size, sizeof(ChildSize)))
+                {
+                    child.sentSize = size;
+                    if (ResizeBenchStep > 0) ResizeBenchCommands++;
+                }
+            }
+        }
+    }
+}
+
+void SettleEmbeddedChild(HWND hWnd)
+{
+    KillTimer(hWnd, IDT_EMBED_SETTLE);
+
+    ChildProcess* child = FindChild(ChildState::Active);
+    if (child == NULL || child->framebuffer != NULL) return;
+
+    RECT cr; // client rectangle
+    GetClientRect(hWnd, &cr);
+    child->embedSize = { cr.right - cr.left, cr.bottom - cr.top };
+    PlaceEmbeddedChild(*child, cr);
+}
+
+void CloseChild(ChildState state)
+{
+    for (auto it = Children.begin(); it != Children.end(); ++it)
+    {
+        if (it->state != state) continue;
+
+        // SDL turns WM_CLOSE on its only window into SDL_QUIT. A child still starting has no window to
+        // close and holds nothing worth saving, so it is terminated rather than left running without Parent.
+        if (it->hwnd != NULL) PostMessage(it->hwnd, WM_CLOSE, 0, 0);
+        else TerminateProcess(it->process.hProcess, 1);
+
+        ReleaseChild(*it);
+        Children.erase(it);
+        return;
+    }
+}
+
+void StartResizeBench(HWND hWnd)
+{
+    GetWindowRect(hWnd, &ResizeBenchRect);
+    ResizeBenchStep = 1;
+    ResizeBenchSizes = ResizeBenchCommands = ResizeBenchFrames = ResizeBenchStalls = 0;
+    ResizeBenchLongestGap = 0.0;
+    QueryPerformanceCounter(&ResizeBenchLastFrame);
+    SetTimer(hWnd, IDT_RESIZE_BENCH, USER_TIMER_MINIMUM, NULL);
+}
+
+void StepResizeBench(HWND hWnd)
+{
+    if (ResizeBenchStep > ResizeBenchSteps)
+    {
+        KillTimer(hWnd, IDT_RESIZE_BENCH);
+        SetWindowPos(hWnd, NULL, 0, 0, ResizeBenchRect.right - ResizeBenchRect.left, ResizeBenchRect.bottom - ResizeBenchRect.top,
+                     SWP_NOMOVE | SWP_NOZORDER | SWP_NOACTIVATE);
+
+        _tprintf(_T("Resize benchmark: %u steps, %u WM_SIZE, %u resizes sent, %u frames presented, %u stalls over %d ms, longest gap %.1f ms\n"),
+                 ResizeBenchSteps, ResizeBenchSizes, ResizeBenchCommands, ResizeBenchFrames, ResizeBenchStalls, RESIZE_BENCH_STALL_MS, ResizeBenchLongestGap);
+
+        ResizeBenchSteps = 0;
+        ResizeBenchStep = 0;
+        return;
+    }
+
+    // Sweep the window back and forth like a mouse drag, 8 pixels per step
+    uint32_t phase = ResizeBenchStep % 64;
+    int offset = (phase < 32 ? phase : 64 - phase) * 8;
+    SetWindowPos(hWnd, NULL, 0, 0, ResizeBenchRect.right - ResizeBenchRect.left + offset, ResizeBenchRect.bottom - ResizeBenchRect.top + offset / 2,
+                 SWP_NOMOVE | SWP_NOZORDER | SWP_NOACTIVATE);
+    ResizeBenchStep++;
+}
+
+void SendDocument(ChildProcess& child)
+{
+    if (DocumentPath.empty()) return;
+    PushCommand(child, CHILD_COMMAND_OPEN, DocumentPath.data(), (uint32_t)(DocumentPath.size() * sizeof(wchar_t)));
+}
+
+// Titles the window with the document and status, e.g. "Parent - big.txt (loading 40%)"
+void SetDocumentTitle(HWND hWnd, const wchar_t* status)
+{
+    std::wstring title(ParentWindowClass.begin(), ParentWindowClass.end());
+    if (!DocumentPath.empty())
+    {
+        size_t slash = DocumentPath.find_last_of(L"\\/");
+        title += L" - " + DocumentPath.substr(slash == std::wstring::npos ? 0 : slash + 1);
+        if (status != NULL) title += std::wstring(L" (") + status + L")";
+    }
+    SetWindowTextW(hWnd, title.c_str());
+}
+
+bool ChooseDocument(HWND hWnd)
+{
+    wchar_t path[MAX_PATH] = L"";
+
+    OPENFILENAMEW ofn; ZeroMemory(&ofn, sizeof(OPENFILENAMEW));
+    ofn.lStructSize = sizeof(OPENFILENAMEW);
+    ofn.hwndOwner = hWnd;
+    ofn.lpstrFilter = L"Documents (*.txt)\0*.txt\0All files (*.*)\0*.*\0";
+    ofn.lpstrFile = path;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST;
+
+    if (!GetOpenFileNameW(&ofn)) return false;
+
+    DocumentPath = path;
+    return true;
+}
+
+bool AdoptChild(HWND hWnd)
+{
+    ChildProcess* child = FindChild(ChildState::Parked);
+    if (child == NULL)
+    {
+        // Adopt the next child as soon as it reports ready
+        AdoptPending = true;
+        return false;
+    }
+
+    LARGE_INTEGER adoptTime;
+    QueryPerformanceCounter(&adoptTime);
+
+    child->state = ChildState::Active;
+
+    if (child->framebuffer != NULL)
+    {
+        // Nothing to show; the child starts publishing frames once it leaves the pool
+        RECT cr; // client rectangle
+        GetClientRect(hWnd, &cr);
+        ChildSize size = { cr.right - cr.left, cr.bottom - cr.top };
+        PushCommand(*child, CHILD_COMMAND_ADOPT, &size, sizeof(ChildSize));
+        child->sentSize = child->pendingSize = size;
+        child->resizeInFlight = true;
+
+        PresentedFrames = 0;
+        PresentedBytes = 0;
+        QueryPerformanceCounter(&PresentStatsStart);
+    }
+    else
+    {
+        ResizeChild(hWnd, *child);
+        ShowWindow(child->hwnd, SW_SHOW);
+    }
+
+    AdoptPending = false;
+    _tprintf(_T("Adopted child %d in %.3f ms\n"), child->process.dwProcessId, ElapsedMilliseconds(adoptTime));
+
+    SendDocument(*child);
+
+    if (IpcBenchMessages > 0 && IpcBenchProcessId == 0)
+    {
+        IpcBenchProcessId = child->process.dwProcessId;
+        IpcBenchSent = IpcBenchReceived = 0;
+        IpcBenchLatencies.clear();
+        IpcBenchLatencies.reserve(IpcBenchMessages);
+        QueryPerformanceCounter(&IpcBenchStart);
+        IpcBenchLastPong = IpcBenchStart;
+        SetTimer(hWnd, IDT_IPC_BENCH, 1000, NULL);
+    }
+
+    if (ResizeBenchSteps > 0 && ResizeBenchStep == 0)
+    {
+        StartResizeBench(hWnd);
+    }
+
+    RefillChildPool(hWnd);
+    return true;
+}
+
+void OnChildReady(HWND hWnd, HWND hwndChild, DWORD processId)
+{
+    for (ChildProcess& child : Children)
+    {
+        if (child.process.dwProcessId != processId || child.state != ChildState::Starting) continue;
+
+        child.state = ChildState::Parked;
+        child.hwnd = hwndChild;
+        ChildStartFailures = 0;
+        _tprintf(_T("Child %d ready in %.1f ms\n"), processId, ElapsedMilliseconds(child.spawnTime));
+
+        // Pages shared with other children (SDL2.dll, opengl32.dll, driver) count towards the working set but not private usage
+        PROCESS_MEMORY_COUNTERS_EX pmc;
+        if (GetProcessMemoryInfo(child.process.hProcess, (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc)))
+        {
+            _tprintf(_T("Child %d working set %.1f MB, private %.1f MB\n"), processId,
+                     pmc.WorkingSetSize / 1048576.0, pmc.PrivateUsage / 1048576.0);
+        }
+
+        if (FindChild(ChildState::Starting) == NULL && RefillCount > 0)
+        {
+            double ms = ElapsedMilliseconds(RefillStart);
+            _tprintf(_T("Spawned %d children in %.1f ms (%.1f children/s)\n"), (int)RefillCount, ms, RefillCount * 1000.0 / ms);
+            RefillCount = 0;
+        }
+
+        if (AdoptPending) AdoptChild(hWnd);
+        return;
+    }
+}
+
+bool PostChildCommand(uint32_t type, const void* payload, uint32_t size)
+{
+    ChildProcess* child = FindChild(ChildState::Active);
+    if (child == NULL) return false;
+
+    return PushCommand(*child, type, payload, size);
+}
+
+bool ReadWatchChanges()
+{
+    // Renames cover editors that save to a temporary file and move it over the document, which only
+    // succeeds for documents Child copies; over a mapped one it fails in the editor and nothing is notified
+    return ReadDirectoryChangesW(WatchDirectory, WatchBuffer, sizeof(WatchBuffer), FALSE,
+                                 FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
+                                 NULL, &WatchOverlapped, NULL) != FALSE;
+}
+
+void StopWatch(HWND hWnd)
+{
+    if (WatchDirectory != INVALID_HANDLE_VALUE)
+    {
+        DWORD bytes = 0;
+        CancelIoEx(WatchDirectory, &WatchOverlapped);
+        GetOverlappedResult(WatchDirectory, &WatchOverlapped, &bytes, TRUE);
+        CloseHandle(WatchDirectory);
+        WatchDirectory = INVALID_HANDLE_VALUE;
+    }
+
+    // The cancelled read signals the event too
+    ResetEvent(WatchEvent);
+    KillTimer(hWnd, IDT_WATCH_DEBOUNCE);
+    WatchChanged = false;
+    WatchReloading = false;
+    WatchPresenting = false;
+}
+
+// Watches the directory of the document for changes to it, which reload it in the active child
+void StartWatch(HWND hWnd)
+{
+    StopWatch(hWnd);
+    if (DocumentPath.empty()) return;
+
+    size_t slash = DocumentPath.find_last_of(L"\\/");
+    std::wstring directory = slash == std::wstring::npos ? L"." : DocumentPath.substr(0, slash + 1);
+
+    WatchDirectory = CreateFileW(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                 OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+
+    ZeroMemory(&WatchOverlapped, sizeof(OVERLAPPED));
+    WatchOverlapped.hEvent = WatchEvent;
+
+    if (WatchDirectory == INVALID_HANDLE_VALUE || !ReadWatchChanges())
+    {
+        _tprintf(_T("Unable to watch the document for changes: %s\n"), LastErrorMessage().c_str());
+        StopWatch(hWnd);
+    }
+}
+
+void OnWatchEvent(HWND hWnd)
+{
+    DWORD bytes = 0;
+    if (WatchDirectory == INVALID_HANDLE_VALUE || !GetOverlappedResult(WatchDirectory, &WatchOverlapped, &bytes, FALSE))
+    {
+        if (WatchDirectory != INVALID_HANDLE_VALUE) _tprintf(_T("Stopped watching the document: %s\n"), LastErrorMessage().c_str());
+        StopWatch(hWnd);
+        return;
+    }
+
+    size_t slash = DocumentPath.find_last_of(L"\\/");
+    const wchar_t* name = DocumentPath.c_str() + (slash == std::wstring::npos ? 0 : slash + 1);
+    int nameLength = (int)wcslen(name);
+
+    // No records means the buffer overflowed and the changes are unknown
+    bool changed = bytes == 0;
+    const BYTE* record = (const BYTE*)WatchBuffer;
+
+    while (!changed && record < (const BYTE*)WatchBuffer + bytes)
+    {
+        const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)record;
+        changed = CompareStringOrdinal(info->FileName, (int)(info->FileNameLength / sizeof(WCHAR)), name, nameLength, TRUE) == CSTR_EQUAL;
+
+        if (info->NextEntryOffset == 0) break;
+        record += info->NextEntryOffset;
+    }
+
+    if (!ReadWatchChanges())
+    {
+        _tprintf(_T("Stopped watching the document: %s\n"), LastErrorMessage().c_str());
+        StopWatch(hWnd);
+        return;
+    }
+
+    if (!changed) return;
+
+    // Saving is a burst of changes; each one restarts the timer
+    if (!WatchChanged) QueryPerformanceCounter(&WatchChangeTime);
+    WatchChanged = true;
+    SetTimer(hWnd, IDT_WATCH_DEBOUNCE, WATCH_DEBOUNCE_MS, NULL);
+}
+
+void OnWatchDebounce(HWND hWnd)
+{
+    KillTimer(hWnd, IDT_WATCH_DEBOUNCE);
+    if (!WatchChanged) return;
+
+    // Open it the way Child maps it, sharing everything; only an editor that denies reading while it writes fails this,
+    // and one that shares reading is waited out by the debounce alone. Every save style reaches here for a document
+    // Child copies, but for one larger than DOCUMENT_COPY_BYTES in Document.h, which stays mapped, only an in-place
+    // write that does not shrink it does, since the editor cannot rename over, delete or truncate a mapped file
+    HANDLE file = CreateFileW(DocumentPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        // Gone for good or in the middle of a rename or delete and recreate of a copied document, which notifies
+        // again once it is back
+        if (GetLastError() == ERROR_SHARING_VIOLATION) SetTimer(hWnd, IDT_WATCH_DEBOUNCE, WATCH_DEBOUNCE_MS, NULL);
+        else WatchChanged = false;
+        return;
+    }
+
+    CloseHandle(file);
+    WatchChanged = false;
+
+    if (PostChildCommand(CHILD_COMMAND_RELOAD, NULL, 0))
+    {
+        QueryPerformanceCounter(&WatchReloadTime);
+        WatchReloading = true;
+        WatchPresenting = false;
+        SetDocumentTitle(hWnd, L"reloading");
+    }
+}
+
+void OnWatchReloaded(bool presented)
+{
+    double total = ElapsedMilliseconds(WatchChangeTime);
+    double reload = ElapsedMilliseconds(WatchReloadTime);
+    double frame = ElapsedMilliseconds(WatchReplyTime);
+
+    _tprintf(_T("Document change to %s in %.1f ms: debounce %.1f ms, reload %.1f ms, frame %.1f ms\n"),
+             presented ? _T("updated frame") : _T("reload reply"), total, total - reload, reload - frame, frame);
+}
+
+void FinishIpcBench(HWND hWnd, bool timedOut)
+{
+    KillTimer(hWnd, IDT_IPC_BENCH);
+    double ms = ElapsedMilliseconds(IpcBenchStart);
+
+    if (timedOut)
+    {
+        _tprintf(_T("IPC benchmark: no pong for %u ms after %u of %u round trips, giving up\n"), IPC_BENCH_TIMEOUT_MS, IpcBenchReceived, IpcBenchMessages);
+    }
+
+    if (!IpcBenchLatencies.empty())
+    {
+        std::sort(IpcBenchLatencies.begin(), IpcBenchLatencies.end());
+
+        _tprintf(_T("IPC benchmark: %u round trips in %.1f ms (%.0f messages/s), %u in flight, p50 %.1f us, p99 %.1f us, max %.1f us\n"),
+                 IpcBenchReceived, ms, IpcBenchReceived * 2000.0 / ms, IPC_BENCH_IN_FLIGHT,
+                 IpcBenchLatencies[IpcBenchLatencies.size() / 2],
+                 IpcBenchLatencies[IpcBenchLatencies.size() * 99 / 100],
+                 IpcBenchLatencies.back());
+    }
+
+    IpcBenchMessages = 0;
+}
+
+void OnIpcBenchPong(HWND hWnd, int64_t timestamp)
+{
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    IpcBenchLatencies.push_back((double)(now.QuadPart - timestamp) * 1000000.0 / (double)frequency.QuadPart);
+    IpcBenchLastPong = now;
+
+    if (++IpcBenchReceived == IpcBenchMessages) FinishIpcBench(hWnd, false);
+}
+
+void CheckIpcBench(HWND hWnd)
+{
+    if (IpcBenchMessages > 0 && ElapsedMilliseconds(IpcBenchLastPong) > IPC_BENCH_TIMEOUT_MS) FinishIpcBench(hWnd, true);
+}
+
+void AcquireChildFrame(HWND hWnd, ChildProcess& child)
+{
+    if (!child.frontBuffer.Acquire()) return;
+
+    // The child rendered since the last resize; send the size it should catch up to
+    child.resizeInFlight = false;
+    FlushResize(child);
+
+    if (WatchPresenting)
+    {
+        WatchPresenting = false;
+        OnWatchReloaded(true);
+    }
+
+    if (ResizeBenchStep > 0)
+    {
+        double gap = ElapsedMilliseconds(ResizeBenchLastFrame);
+        QueryPerformanceCounter(&ResizeBenchLastFrame);
+        ResizeBenchFrames++;
+        ResizeBenchLongestGap = std::max(ResizeBenchLongestGap, gap);
+        if (gap > RESIZE_BENCH_STALL_MS) ResizeBenchStalls++;
+    }
+
+    const FramebufferSlot& frame = child.framebuffer->slots[child.frontBuffer.Front()];
+    bool consecutive = frame.sequence == child.acquiredSequence + 1;
+    child.acquiredSequence = frame.sequence;
+
+    // Skipped frames have their own damage; repaint everything then
+    if (!consecutive)
+    {
+        InvalidateRect(hWnd, NULL, FALSE);
+        return;
+    }
+
+    // Damage is bottom-up, client coordinates top-down
+    RECT damage = { frame.damageX, frame.height - frame.damageY - frame.damageHeight,
+                    frame.damageX + frame.damageWidth, frame.height - frame.damageY };
+    InvalidateRect(hWnd, &damage, FALSE);
+}
+
+bool PollChildren(HWND hWnd)
+{
+    bool busy = false;
+
+    for (ChildProcess& child : Children)
+    {
+        if (child.channel == NULL) continue;
+
+        if (child.state == ChildState::Active && child.framebuffer != NULL)
+        {
+            AcquireChildFrame(hWnd, child);
+            FlushPointer(child);
+        }
+
+        // Keep a few pings in flight while a benchmark is running; each pong makes room for the next
+        if (child.process.dwProcessId == IpcBenchProcessId)
+        {
+            while (IpcBenchSent < IpcBenchMessages && IpcBenchSent - IpcBenchReceived < IPC_BENCH_IN_FLIGHT)
+            {
+                LARGE_INTEGER now;
+                QueryPerformanceCounter(&now);
+                if (!child.commands.Push(CHILD_COMMAND_PING, &now.QuadPart, sizeof(int64_t))) break;
+                IpcBenchSent++;
+            }
+
+            NotifyChild(child);
+        }
+
+        while (const RingRecord* record = child.replies.Peek())
+        {
+            switch (record->type)
+            {
+                case CHILD_REPLY_PONG:
+                {
+                    int64_t timestamp;
+                    memcpy(&timestamp, record + 1, sizeof(int64_t));
+                    if (child.process.dwProcessId == IpcBenchProcessId && IpcBenchMessages > 0) OnIpcBenchPong(hWnd, timestamp);
+                    break;
+                }
+
+                case CHILD_REPLY_ACK:
+                {
+                    uint32_t command;
+                    memcpy(&command, record + 1, sizeof(uint32_t));
+                    _tprintf(_T("Child %d handled command %u\n"), child.process.dwProcessId, command);
+                    break;
+                }
+
+                case CHILD_REPLY_DOCUMENT:
+                {
+                    ChildDocument document;
+                    memcpy(&document, record + 1, sizeof(ChildDocument));
+
+                    if (document.opened)
+                    {
+                        _tprintf(_T("Child %d %s %llu items (%.1f MB%s) in %u ms, %.1f%% reused, peak working set %.1f MB\n"), child.process.dwProcessId,
+                                 document.reloaded ? _T("reloaded") : _T("opened"), document.items, document.bytes / 1048576.0,
+                                 document.packed ? _T(" pack") : _T(""), document.loadMilliseconds,
+                                 document.reused * 100.0 / std::max<uint64_t>(document.bytes, 1), document.peakWorkingSet / 1048576.0);
+                    }
+                    else if (document.reloaded)
+                    {
+                        _tprintf(_T("Child %d could not reload the document and kept the previous version\n"), child.process.dwProcessId);
+                    }
+                    else
+                    {
+                        _tprintf(_T("Child %d could not open the document\n"), child.process.dwProcessId);
+                    }
+                    SetDocumentTitle(hWnd, document.opened ? NULL : document.reloaded ? L"reload failed" : L"not a document");
+
+                    // Frames only pass through Parent in framebuffer mode; otherwise the child presents one on its next vsync
+                    if (document.reloaded && WatchReloading && child.state == ChildState::Active)
+                    {
+                        WatchReloading = false;
+                        QueryPerformanceCounter(&WatchReplyTime);
+                        if (child.framebuffer != NULL && document.opened) WatchPresenting = true;
+                        else OnWatchReloaded(false);
+                    }
+                    break;
+                }
+
+                case CHILD_REPLY_PROGRESS:
+                {
+                    ChildProgress progress;
+                    memcpy(&progress, record + 1, sizeof(ChildProgress));
+
+                    wchar_t status[64];
+                    swprintf_s(status, L"loading %.0f%%, %llu items", progress.bytes * 100.0 / std::max<uint64_t>(progress.size, 1), progress.items);
+                    SetDocumentTitle(hWnd, status);
+                    break;
+                }
+            }
+
+            child.replies.Consume();
+            busy = true;
+        }
+    }
+
+    return busy;
+}
+
+void SetParentWaiting(bool waiting)
+{
+    for (ChildProcess& child : Children)
+    {
+        child.channel->parentWaiting.store(waiting ? 1 : 0, std::memory_order_seq_cst);
+    }
+}
+
+void OnChildExited(HWND hWnd, size_t index)
+{
+    ChildProcess& child = Children[index];
+
+    DWORD exitCode = 0;
+    GetExitCodeProcess(child.process.hProcess, &exitCode);
+    _tprintf(_T("Child %d exited with code %d\n"), child.process.dwProcessId, exitCode);
+
+    bool active = child.state == ChildState::Active;
+    bool starting = child.state == ChildState::Starting;
+    ReleaseChild(child);
+    Children.erase(Children.begin() + index);
+
+    if (active) InvalidateRect(hWnd, NULL, TRUE);
+    if (!starting)
+    {
+        RefillChildPool(hWnd);
+        return;
+    }
+
+    // Exiting before it was ready likely repeats; back off and eventually stop rather than spawn in a loop
+    if (++ChildStartFailures == CHILD_RESPAWN_LIMIT)
+    {
+        _tprintf(_T("%d children exited before they were ready, no longer refilling the child pool\n"), CHILD_RESPAWN_LIMIT);
+    }
+    else if (ChildStartFailures < CHILD_RESPAWN_LIMIT)
+    {
+        RespawnWaiting = true;
+        SetTimer(hWnd, IDT_CHILD_RESPAWN, CHILD_RESPAWN_MS << (ChildStartFailures - 1), NULL);
+    }
+}
+
+void OnChildRespawn(HWND hWnd)
+{
+    KillTimer(hWnd, IDT_CHILD_RESPAWN);
+    RespawnWaiting = false;
+    RefillChildPool(hWnd);
+}
+
+int RunMessageLoop(HWND hWnd)
+{
+    MSG msg; ZeroMemory(&msg, sizeof(MSG));
+    std::vector<HANDLE> handles;
+
+    for (;;)
+    {
+        // Dispatch everything pending before blocking again
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+        {
+            if (msg.message == WM_QUIT) return (int)msg.wParam;
+
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+
+        // Announce the wait before the final poll so a reply pushed in between still signals ReplyEvent
+        SetParentWaiting(true);
+        bool busy = PollChildren(hWnd);
+
+        // Wake on window messages, replies from any child, changes to the document, or a child process exiting
+        handles.clear();
+        handles.push_back(ReplyEvent);
+        handles.push_back(WatchEvent);
+        for (const ChildProcess& child : Children)
+        {
+            if (handles.size() == MAXIMUM_WAIT_OBJECTS - 1) break;
+            handles.push_back(child.process.hProcess);
+        }
+
+        DWORD result = MsgWaitForMultipleObjectsEx((DWORD)handles.size(), handles.data(), busy ? 0 : INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+        SetParentWaiting(false);
+
+        if (result == WAIT_OBJECT_0 + 1)
+        {
+            OnWatchEvent(hWnd);
+        }
+        else if (result > WAIT_OBJECT_0 + 1 && result < WAIT_OBJECT_0 + handles.size())
+        {
+            OnChildExited(hWnd, result - WAIT_OBJECT_0 - 2);
+        }
+        else if (result == WAIT_FAILED)
+        {
+            LastErrorMessageBox();
+            return 1;
+        }
+    }
+}
+
+void PresentChild(HDC hdc, ChildProcess& child, const RECT& paint)
+{
+    uint32_t slot = child.frontBuffer.Front();
+    const FramebufferSlot& frame = child.framebuffer->slots[slot];
+    RECT bounds = { 0, 0, frame.sequence ? frame.width : 0, frame.sequence ? frame.height : 0 };
+
+    // The frame lags a resize, so the client area it does not cover yet would keep stale pixels
+    int saved = SaveDC(hdc);
+    ExcludeClipRect(hdc, bounds.left, bounds.top, bounds.right, bounds.bottom);
+    FillRect(hdc, &paint, (HBRUSH)(COLOR_WINDOW + 2));
+    RestoreDC(hdc, saved);
+
+    // Only blit the invalidated part of the frame
+    RECT area;
+    if (!IntersectRect(&area, &paint, &bounds)) return;
+
+    // Blit straight from the shared mapping; the pixels are never copied into Parent's memory
+    BITMAPINFO bmi;
+    ZeroMemory(&bmi, sizeof(BITMAPINFO));
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = frame.width;
+    bmi.bmiHeader.biHeight = frame.height; // bottom-up
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    // Source y counts from the bottom row of the bottom-up frame
+    int width = area.right - area.left;
+    int height = area.bottom - area.top;
+    SetDIBitsToDevice(hdc, area.left, area.top, width, height, area.left, frame.height - area.bottom, 0, frame.height,
+                      FramebufferPixels(child.framebuffer, slot), &bmi, DIB_RGB_COLORS);
+
+    PresentedFrames++;
+    PresentedBytes += (unsigned long long)width * height * 4;
+
+    double ms = ElapsedMilliseconds(PresentStatsStart);
+    if (ms >= 1000.0)
+    {
+        _tprintf(_T("Presented %.1f frames/s at %dx%d, %.1f MB/s from shared memory, 0 bytes copied\n"),
+                 PresentedFrames * 1000.0 / ms, frame.width, frame.height, PresentedBytes / 1048576.0 * 1000.0 / ms);
+        PresentedFrames = 0;
+        PresentedBytes = 0;
+        QueryPerformanceCounter(&PresentStatsStart);
+    }
 }
 
 void CreateMenuBar(HWND hWnd)
@@ -90,6 +1170,12 @@ void CreateMenuBar(HWND hWnd)
 
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
+    if (message == ChildReadyMessage)
+    {
+        OnChildReady(hWnd, (HWND)wParam, (DWORD)lParam);
+        return 0;
+    }
+
     switch (message)
     {
         case WM_COMMAND: // menu selections and accelerators
@@ -101,24 +1187,41 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                 case IDM_FILE_NEW:
                 {
                     printf("New file\n");
+                    DocumentPath.clear();
+                    StopWatch(hWnd);
+                    SetDocumentTitle(hWnd, NULL);
+                    CloseChild(ChildState::Active);
+                    AdoptChild(hWnd);
                     break;
                 }
 
                 case IDM_FILE_LOAD:
                 {
                     printf("Load file\n");
+                    ChildProcess* child = FindChild(ChildState::Active);
+                    if (child != NULL && ChooseDocument(hWnd))
+                    {
+                        StartWatch(hWnd);
+                        SetDocumentTitle(hWnd, L"loading");
+                        SendDocument(*child);
+                    }
                     break;
                 }
 
                 case IDM_FILE_RELOAD:
                 {
                     printf("Reload file\n");
+                    if (!DocumentPath.empty() && PostChildCommand(CHILD_COMMAND_RELOAD, NULL, 0)) SetDocumentTitle(hWnd, L"reloading");
                     break;
                 }
 
                 case IDM_FILE_CLOSE:
                 {
                     printf("Close file\n");
+                    DocumentPath.clear();
+                    StopWatch(hWnd);
+                    SetDocumentTitle(hWnd, NULL);
+                    CloseChild(ChildState::Active);
                     break;
                 }
 
@@ -132,18 +1235,21 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                 case IDM_LAYOUT_LOAD:
                 {
                     printf("Load layout\n");
+                    PostChildCommand(CHILD_COMMAND_LAYOUT_LOAD, NULL, 0);
                     break;
                 }
 
                 case IDM_LAYOUT_SAVE:
                 {
                     printf("Save layout\n");
+                    PostChildCommand(CHILD_COMMAND_LAYOUT_SAVE, NULL, 0);
                     break;
                 }
 
                 case IDM_LAYOUT_RESET:
                 {
                     printf("Reset layout\n");
+                    PostChildCommand(CHILD_COMMAND_LAYOUT_RESET, NULL, 0);
                     break;
                 }
 
@@ -166,39 +1272,99 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         {
             PAINTSTRUCT ps;
             HDC hdc = BeginPaint(hWnd, &ps);
-            FillRect(hdc, &ps.rcPaint, (HBRUSH)(COLOR_WINDOW + 2));
+            ChildProcess* child = FindChild(ChildState::Active);
+
+            if (child != NULL && child->framebuffer != NULL)
+            {
+                PresentChild(hdc, *child, ps.rcPaint);
+            }
+            else
+            {
+                FillRect(hdc, &ps.rcPaint, (HBRUSH)(COLOR_WINDOW + 2));
+            }
+
             EndPaint(hWnd, &ps);
             break;
         }
 
-        case WM_SIZE:
+        case WM_MOUSEMOVE:
         {
-            EnumChildWindows(hWnd, (WNDENUMPROC)&GetChildHWND, 0);
+            // Framebuffer children have no window of their own to receive pointer input
+            ChildProcess* child = FindChild(ChildState::Active);
 
-            // Resize child to content inner content of parent
-            if (ChildHwnd != NULL)
+            if (child != NULL && child->framebuffer != NULL)
             {
-                // Get size of parent
-                RECT cr; // client rectangle
-                GetClientRect(hWnd, &cr);
-
-                if (cr.left >= 0 && cr.right >= 0 && cr.top >= 0 && cr.bottom >= 0)
+                if (!PointerTracked)
                 {
-                    MoveWindow(ChildHwnd, cr.left, cr.top, cr.right - cr.left, cr.bottom - cr.top, FALSE);
+                    TRACKMOUSEEVENT tme = { sizeof(TRACKMOUSEEVENT), TME_LEAVE, hWnd, 0 };
+                    PointerTracked = TrackMouseEvent(&tme) != FALSE;
                 }
+
+                child->pendingPointer = { (short)LOWORD(lParam), (short)HIWORD(lParam) };
+                child->pointerPending = true;
+                FlushPointer(*child);
+            }
+            break;
+        }
+
+        case WM_MOUSELEAVE:
+        {
+            PointerTracked = false;
+            ChildProcess* child = FindChild(ChildState::Active);
+
+            if (child != NULL && child->framebuffer != NULL)
+            {
+                child->pendingPointer = { -1, -1 };
+                child->pointerPending = true;
+                FlushPointer(*child);
             }
+            break;
+        }
 
+        case WM_TIMER:
+        {
+            if (wParam == IDT_CPU_REPORT) ReportCpuUsage();
+            else if (wParam == IDT_SIZE_MOVE) PollChildren(hWnd);
+            else if (wParam == IDT_RESIZE_BENCH) StepResizeBench(hWnd);
+            else if (wParam == IDT_WATCH_DEBOUNCE) OnWatchDebounce(hWnd);
+            else if (wParam == IDT_IPC_BENCH) CheckIpcBench(hWnd);
+            else if (wParam == IDT_EMBED_SETTLE) SettleEmbeddedChild(hWnd);
+            else if (wParam == IDT_CHILD_RESPAWN) OnChildRespawn(hWnd);
             break;
         }
 
-        case WM_CLOSE:
+        case WM_ENTERSIZEMOVE:
+        {
+            // The modal sizing loop bypasses RunMessageLoop; keep presenting child frames while dragging
+            SetTimer(hWnd, IDT_SIZE_MOVE, USER_TIMER_MINIMUM, NULL);
+            break;
+        }
+
+        case WM_EXITSIZEMOVE:
+        {
+            KillTimer(hWnd, IDT_SIZE_MOVE);
+            break;
+        }
+
+        case WM_SIZE:
         {
-            EnumChildWindows(hWnd, (WNDENUMPROC)&GetChildHWND, 0);
+            ChildProcess* child = FindChild(ChildState::Active);
 
-            if (ChildHwnd != NULL)
+            if (child != NULL)
+            {
+                ResizeChild(hWnd, *child);
+            }
+
+            if (ResizeBenchStep > 0) ResizeBenchSizes++;
+            break;
+        }
+
+        case WM_CLOSE:
+        {
+            // Close the active child along with every parked or starting one
+            while (!Children.empty())
             {
-                // TODO: send quit message to child
-                DestroyWindow(hWnd);
+                CloseChild(Children.front().state);
             }
 
             DestroyWindow(hWnd);
@@ -235,6 +1401,93 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
     freopen_s(&out, "CONOUT$", "w", stdout);
     freopen_s(&err, "CONOUT$", "w", stderr);
 
+    // Parse command line options
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (wcscmp(argv[i], L"-pool") == 0 && i + 1 < argc)
+        {
+            int size = _wtoi(argv[++i]);
+            ChildPoolSize = size > 0 ? (size_t)size : 1;
+        }
+        else if (wcscmp(argv[i], L"-framebuffer") == 0)
+        {
+            FramebufferMode = true;
+        }
+        else if (wcscmp(argv[i], L"-ondemand") == 0)
+        {
+            OnDemandMode = true;
+        }
+        else if (wcscmp(argv[i], L"-software") == 0)
+        {
+            // CPU rendering only targets the shared framebuffer
+            SoftwareMode = true;
+            FramebufferMode = true;
+        }
+        else if (wcscmp(argv[i], L"-fps") == 0 && i + 1 < argc)
+        {
+            int rate = _wtoi(argv[++i]);
+            FrameRate = rate > 0 ? (uint32_t)rate : 0;
+        }
+        else if (wcscmp(argv[i], L"-rendercost") == 0 && i + 1 < argc)
+        {
+            int ms = _wtoi(argv[++i]);
+            RenderCost = ms > 0 ? (uint32_t)ms : 0;
+        }
+        else if (wcscmp(argv[i], L"-benchresize") == 0 && i + 1 < argc)
+        {
+            int steps = _wtoi(argv[++i]);
+            ResizeBenchSteps = steps > 0 ? (uint32_t)steps : 0;
+        }
+        else if (wcscmp(argv[i], L"-renderthreads") == 0 && i + 1 < argc)
+        {
+            int threads = _wtoi(argv[++i]);
+            RenderThreads = threads > 0 ? (uint32_t)threads : 0;
+        }
+        else if (wcscmp(argv[i], L"-cpureport") == 0 && i + 1 < argc)
+        {
+            int seconds = _wtoi(argv[++i]);
+            CpuReportInterval = seconds > 0 ? (UINT)seconds : 0;
+        }
+        else if (wcscmp(argv[i], L"-benchipc") == 0 && i + 1 < argc)
+        {
+            int messages = _wtoi(argv[++i]);
+            IpcBenchMessages = messages > 0 ? (uint32_t)messages : 0;
+        }
+        else if (wcscmp(argv[i], L"-open") == 0 && i + 1 < argc)
+        {
+            DocumentPath = argv[++i];
+        }
+    }
+
+    LocalFree(argv);
+
+    // Children announce themselves with this message once SDL and OpenGL are initialized
+    ChildReadyMessage = RegisterWindowMessage(ChildReadyMessageName.c_str());
+
+    // Children signal this event after posting replies while Parent waits
+    SECURITY_ATTRIBUTES sa;
+    sa.nLength = sizeof(SECURITY_ATTRIBUTES);
+    sa.lpSecurityDescriptor = NULL;
+    sa.bInheritHandle = TRUE;
+
+    ReplyEvent = CreateEvent(&sa, FALSE, FALSE, NULL);
+    if (ReplyEvent == NULL)
+    {
+        LastErrorMessageBox();
+        return 1;
+    }
+
+    // Completes reads of changes to the directory of the document
+    WatchEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (WatchEvent == NULL)
+    {
+        LastErrorMessageBox();
+        return 1;
+    }
+
     // Create window class
     WNDCLASSEX wcex;
     wcex.cbSize = sizeof(WNDCLASSEX);
@@ -278,11 +1531,10 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
         return 1;
     }
 
-    TCHAR lpChildPath[MAX_PATH];
-    _stprintf_s(lpChildPath, _T("%ls\\%ls.exe"), lpParentExecutablePath, ChildWindowClass.c_str());
+    _stprintf_s(ChildPath, _T("%ls\\%ls.exe"), lpParentExecutablePath, ChildWindowClass.c_str());
 
     WIN32_FIND_DATA FindFileData;
-    HANDLE hFind = FindFirstFile(lpChildPath, &FindFileData);
+    HANDLE hFind = FindFirstFile(ChildPath, &FindFileData);
     if (hFind == INVALID_HANDLE_VALUE)
     {
         LastErrorMessageBox();
@@ -291,48 +1543,34 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
 
     FindClose(hFind);
 
-    // Set child process startup and process info
-    STARTUPINFO lpStartupInfo;
-    ZeroMemory(&lpStartupInfo, sizeof(STARTUPINFO));
-    lpStartupInfo.cb = sizeof(lpStartupInfo);
-
-    PROCESS_INFORMATION lpProcessInformation;
-    ZeroMemory(&lpProcessInformation, sizeof(PROCESS_INFORMATION));
-
-    // Get parent process id
-    DWORD lpdwProcessId;
-    GetWindowThreadProcessId(hWnd, &lpdwProcessId);
-
-    TCHAR lpProcessId[10];
-    _stprintf_s(lpProcessId, _T("%d"), lpdwProcessId);
-    _tprintf(_T("%s\n"), lpProcessId);
-
-    TCHAR lpCommandLine[1024];
-    _stprintf_s(lpCommandLine, _T("%ls %ls"), lpChildPath, lpProcessId);
-
-    // Create process
-    BOOL success = CreateProcess(lpChildPath, lpCommandLine, NULL, NULL, TRUE, 0, NULL, NULL, &lpStartupInfo, &lpProcessInformation);
+    // Start the child pool; the first child to report ready is adopted
+    RefillChildPool(hWnd);
 
     // Create menu
     CreateMenuBar(hWnd);
 
+    // Reload the document given with -open whenever it is saved
+    StartWatch(hWnd);
+
     // Show window
     ShowWindow(hWnd, nCmdShow);
     UpdateWindow(hWnd);
 
-    // Message pump
-    MSG msg; ZeroMemory(&msg, sizeof(MSG));
-
-    while (msg.message != WM_QUIT)
+    // Report CPU usage periodically
+    if (CpuReportInterval > 0)
     {
-        if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
-        {
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
-        }
+        ReportCpuUsage();
+        SetTimer(hWnd, IDT_CPU_REPORT, CpuReportInterval * 1000, NULL);
     }
 
-    return (int)msg.wParam;
+    // Message loop
+    int exitCode = RunMessageLoop(hWnd);
+
+    StopWatch(hWnd);
+    CloseHandle(WatchEvent);
+    CloseHandle(ReplyEvent);
+
+    return exitCode;
 }
 
 INT_PTR CALLBACK About(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
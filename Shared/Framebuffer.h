@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include <TripleBuffer.h>
+
+
+// Shared framebuffer mode: Child reads its frames back straight into one of three slots of a
+// mapping owned by Parent, and Parent presents the front slot from the same mapping. Slots hold
+// bottom-up 32-bit BGRA rows, which is both the GL read-back order and a bottom-up DIB.
+#define FRAMEBUFFER_SLOTS       3
+#define FRAMEBUFFER_ALIGNMENT   4096
+
+struct FramebufferSlot
+{
+    uint32_t sequence;      // frame number, 0 while the slot has never been written
+    int32_t width;
+    int32_t height;
+    int32_t damageX;        // area that changed since frame sequence - 1, bottom-up like the pixels
+    int32_t damageY;
+    int32_t damageWidth;
+    int32_t damageHeight;
+};
+
+struct FramebufferHeader
+{
+    alignas(64) std::atomic<uint32_t> middle;     // see TripleBuffer.h
+    alignas(64) FramebufferSlot slots[FRAMEBUFFER_SLOTS];
+    int32_t maxWidth;
+    int32_t maxHeight;
+};
+
+inline size_t FramebufferSlotSize(int32_t maxWidth, int32_t maxHeight)
+{
+    size_t size = (size_t)maxWidth * (size_t)maxHeight * 4;
+    return (size + FRAMEBUFFER_ALIGNMENT - 1) & ~(size_t)(FRAMEBUFFER_ALIGNMENT - 1);
+}
+
+inline size_t FramebufferMappingSize(int32_t maxWidth, int32_t maxHeight)
+{
+    return FRAMEBUFFER_ALIGNMENT + FRAMEBUFFER_SLOTS * FramebufferSlotSize(maxWidth, maxHeight);
+}
+
+inline uint8_t* FramebufferPixels(FramebufferHeader* header, uint32_t slot)
+{
+    return (uint8_t*)header + FRAMEBUFFER_ALIGNMENT + slot * FramebufferSlotSize(header->maxWidth, header->maxHeight);
+}
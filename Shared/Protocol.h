@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <Framebuffer.h>
+#include <Ring.h>
+
+
+// Parent passes the read end of an inherited pipe as the only command line argument of Child
+// and writes a ChildHello to it before anything else.
+#define CHILD_PROTOCOL_MAGIC        0x44484350  // "PCHD"
+#define CHILD_PROTOCOL_VERSION      14
+
+// capabilities
+#define CHILD_CAPABILITY_EMBED          0x00000001  // reparent the child window into parentWindow
+#define CHILD_CAPABILITY_FRAMEBUFFER    0x00000002  // render into the shared framebuffer instead of a window
+#define CHILD_CAPABILITY_ON_DEMAND      0x00000004  // only render when the scene changed, block otherwise
+#define CHILD_CAPABILITY_SOFTWARE       0x00000008  // render on the CPU into the shared framebuffer, no OpenGL
+
+struct ChildHello
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;              // sizeof(ChildHello) as seen by Parent
+    uint32_t capabilities;
+    uint64_t parentWindow;      // embedding target (HWND)
+    uint32_t parentProcessId;
+    int32_t width;              // initial client size
+    int32_t height;
+    uint32_t frameRate;         // target frames per second, 0 renders unthrottled
+    uint32_t renderCost;        // artificial milliseconds of work per frame, for latency benchmarks
+    uint32_t renderThreads;     // CPU rendering threads with CHILD_CAPABILITY_SOFTWARE, 0 for one per core
+    uint64_t channel;           // inherited file mapping holding a ChildChannel (HANDLE)
+    uint64_t framebuffer;       // inherited file mapping holding a FramebufferHeader and its slots (HANDLE), or 0
+    uint64_t replyEvent;        // inherited auto-reset event waking Parent while it waits (HANDLE)
+    uint64_t commandEvent;      // inherited auto-reset event waking Child while it waits (HANDLE)
+};
+
+// commands (Parent -> Child)
+#define CHILD_COMMAND_PING          1   // payload: int64_t timestamp, echoed back in CHILD_REPLY_PONG
+#define CHILD_COMMAND_OPEN          2   // payload: UTF-16 document path, not terminated
+#define CHILD_COMMAND_RELOAD        3   // indexes the open document again, parsing only the chunks that changed
+#define CHILD_COMMAND_LAYOUT_LOAD   4
+#define CHILD_COMMAND_LAYOUT_SAVE   5
+#define CHILD_COMMAND_LAYOUT_RESET  6
+#define CHILD_COMMAND_ADOPT         7   // payload: ChildSize; leaves the pool in framebuffer mode
+#define CHILD_COMMAND_RESIZE        8   // payload: ChildSize
+#define CHILD_COMMAND_POINTER       9   // payload: ChildPoint in client coordinates, negative once the pointer left
+
+// replies (Child -> Parent)
+#define CHILD_REPLY_PONG            101
+#define CHILD_REPLY_ACK             102 // payload: uint32_t command
+#define CHILD_REPLY_DOCUMENT        103 // payload: ChildDocument, once an open finished
+#define CHILD_REPLY_PROGRESS        104 // payload: ChildProgress, while a document loads
+
+struct ChildSize
+{
+    int32_t width;
+    int32_t height;
+};
+
+struct ChildPoint
+{
+    int32_t x;
+    int32_t y;
+};
+
+struct ChildDocument
+{
+    uint32_t opened;            // 0 when the file could not be opened or is not a document
+    uint32_t reloaded;          // 1 for CHILD_COMMAND_RELOAD, which keeps the previous version when it fails
+    uint32_t packed;            // 1 when opened from an up to date pack next to the document, without parsing
+    uint32_t loadMilliseconds;
+    uint64_t bytes;
+    uint64_t items;
+    uint64_t reused;            // bytes whose index a reload kept from the previous version
+    uint64_t peakWorkingSet;    // of the child process, in bytes
+};
+
+struct ChildProgress
+{
+    uint64_t bytes;             // indexed so far
+    uint64_t size;
+    uint64_t items;
+};
+
+#define CHILD_RING_CAPACITY         (64 * 1024)
+
+struct ChildChannel
+{
+    RingHeader commands;
+    RingHeader replies;
+    alignas(RING_CACHE_LINE) std::atomic<uint32_t> parentWaiting;  // Child signals replyEvent only while set
+    alignas(RING_CACHE_LINE) std::atomic<uint32_t> childWaiting;   // Parent signals commandEvent only while set
+    uint8_t commandData[CHILD_RING_CAPACITY];
+    uint8_t replyData[CHILD_RING_CAPACITY];
+};
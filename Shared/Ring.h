@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+
+// Single-producer/single-consumer byte ring living in memory shared between Parent and Child.
+// Head and tail are free-running byte counters on separate cache lines; each side only writes
+// its own counter, so posting and draining records needs no locks and no system calls.
+#define RING_CACHE_LINE     64
+#define RING_ALIGNMENT      8
+#define RING_PADDING        0xFFFFFFFF  // record type filling the unused end of the buffer before a wrap
+
+struct RingHeader
+{
+    alignas(RING_CACHE_LINE) std::atomic<uint32_t> head;    // written by producer
+    alignas(RING_CACHE_LINE) std::atomic<uint32_t> tail;    // written by consumer
+};
+
+struct RingRecord
+{
+    uint32_t type;
+    uint32_t size;      // payload bytes following the record header
+};
+
+class Ring
+{
+public:
+    Ring() : header(nullptr), data(nullptr), capacity(0), cachedHead(0), cachedTail(0) {}
+
+    // capacity must be a power of two
+    Ring(RingHeader* header, uint8_t* data, uint32_t capacity)
+        : header(header), data(data), capacity(capacity)
+    {
+        cachedHead = header->head.load(std::memory_order_acquire);
+        cachedTail = header->tail.load(std::memory_order_acquire);
+    }
+
+    static void Initialize(RingHeader* header)
+    {
+        header->head.store(0, std::memory_order_relaxed);
+        header->tail.store(0, std::memory_order_relaxed);
+    }
+
+    // Producer side; returns false when the ring is full
+    bool Push(uint32_t type, const void* payload, uint32_t size)
+    {
+        uint32_t length = Align(sizeof(RingRecord) + size);
+        if (length > capacity / 2) return false;
+
+        uint32_t head = header->head.load(std::memory_order_relaxed);
+        uint32_t offset = head & (capacity - 1);
+        uint32_t padding = (capacity - offset < length) ? capacity - offset : 0;
+
+        // Only look at the consumer's cache line when the cached tail says we are full
+        if (head + padding + length - cachedTail > capacity)
+        {
+            cachedTail = header->tail.load(std::memory_order_acquire);
+            if (head + padding + length - cachedTail > capacity) return false;
+        }
+
+        if (padding > 0)
+        {
+            RingRecord* pad = (RingRecord*)(data + offset);
+            pad->type = RING_PADDING;
+            pad->size = padding - sizeof(RingRecord);
+            head += padding;
+            offset = 0;
+        }
+
+        RingRecord* record = (RingRecord*)(data + offset);
+        record->type = type;
+        record->size = size;
+        if (size > 0) memcpy(record + 1, payload, size);
+
+        header->head.store(head + length, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; returns the oldest record or nullptr when empty. The record stays valid until Consume.
+    const RingRecord* Peek()
+    {
+        for (;;)
+        {
+            uint32_t tail = header->tail.load(std::memory_order_relaxed);
+
+            if (tail == cachedHead)
+            {
+                cachedHead = header->head.load(std::memory_order_acquire);
+                if (tail == cachedHead) return nullptr;
+            }
+
+            const RingRecord* record = (const RingRecord*)(data + (tail & (capacity - 1)));
+            if (record->type != RING_PADDING) return record;
+
+            header->tail.store(tail + sizeof(RingRecord) + record->size, std::memory_order_release);
+        }
+    }
+
+    void Consume()
+    {
+        uint32_t tail = header->tail.load(std::memory_order_relaxed);
+        const RingRecord* record = (const RingRecord*)(data + (tail & (capacity - 1)));
+        header->tail.store(tail + Align(sizeof(RingRecord) + record->size), std::memory_order_release);
+    }
+
+    bool Empty() const
+    {
+        return header->tail.load(std::memory_order_relaxed) == header->head.load(std::memory_order_acquire);
+    }
+
+private:
+    static uint32_t Align(uint32_t size)
+    {
+        return (size + RING_ALIGNMENT - 1) & ~(uint32_t)(RING_ALIGNMENT - 1);
+    }
+
+    RingHeader* header;
+    uint8_t* data;
+    uint32_t capacity;
+    uint32_t cachedHead;    // consumer's last seen head
+    uint32_t cachedTail;    // producer's last seen tail
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+
+// Lock-free triple buffer index exchange. The writer owns the back buffer and the reader owns the
+// front buffer; the third buffer sits in the shared middle word together with a flag telling
+// whether it holds a frame the reader has not seen yet. Both sides swap through a single atomic
+// exchange, so neither ever waits for the other and the writer never overwrites the front buffer.
+#define TRIPLE_BUFFER_INDEX     0x3
+#define TRIPLE_BUFFER_FRESH     0x4
+
+inline void InitializeTripleBuffer(std::atomic<uint32_t>* middle)
+{
+    middle->store(1, std::memory_order_relaxed);
+}
+
+class TripleBufferWriter
+{
+public:
+    TripleBufferWriter() : middle(nullptr), back(0) {}
+    explicit TripleBufferWriter(std::atomic<uint32_t>* middle) : middle(middle), back(0) {}
+
+    uint32_t Back() const { return back; }
+
+    // Hands the back buffer to the reader and takes over the previous middle buffer
+    void Publish()
+    {
+        back = middle->exchange(back | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel) & TRIPLE_BUFFER_INDEX;
+    }
+
+private:
+    std::atomic<uint32_t>* middle;
+    uint32_t back;
+};
+
+class TripleBufferReader
+{
+public:
+    TripleBufferReader() : middle(nullptr), front(2) {}
+    explicit TripleBufferReader(std::atomic<uint32_t>* middle) : middle(middle), front(2) {}
+
+    uint32_t Front() const { return front; }
+
+    bool Fresh() const
+    {
+        return (middle->load(std::memory_order_acquire) & TRIPLE_BUFFER_FRESH) != 0;
+    }
+
+    // Swaps in the most recently published buffer; returns false when nothing new was published
+    bool Acquire()
+    {
+        if (!Fresh()) return false;
+        front = middle->exchange(front, std::memory_order_acq_rel) & TRIPLE_BUFFER_INDEX;
+        return true;
+    }
+
+private:
+    std::atomic<uint32_t>* middle;
+    uint32_t front;
+};